@@ -1,6 +1,7 @@
 #pragma once
 #include "../util/object.h"
 #include "../util/string.h"
+#include "../util/pool.h"
 #include <cstring>
 #include <assert.h>
 #include <stdlib.h>
@@ -13,121 +14,59 @@
  * @date January 26, 2020
  */
 
+class FixedStrArray;
+
 /**
- * Represents an array of Objects.
+ * What FixedArray and the code around it need to know about an element
+ * type: the tag its chunks travel under ('I', 'F', 'B', 'C' or 'S'), the
+ * chunk class that holds it, whether its elements can be copied as raw
+ * bytes, and how two elements compare.
  */
-class FixedArray : public Object {
-	public:
-		Object** array;
-		size_t used;
-		size_t capacity;
-
-
-		/**
-		 * Default constructor of this array.
-		 */
-		FixedArray() {
-			used = 0;
-			capacity = 1;
-			array  = new Object*[1];
-			for (int i = 0; i < capacity; i++) {
-				array[i] = nullptr;
-			}
-		}
+template <class T>
+struct ArrayTraits;
 
+template <class T>
+class FixedArray;
 
-		/**
-		 * Constructor of this array of Object.
-		 *
-		 * @param size the base size of this array
-		 */
-		FixedArray(size_t size) : Object() {
-			used = 0;
-			capacity = size;
-			array  = new Object*[size];
-			for (int i = 0; i < capacity; i++) {
-				array[i] = nullptr;
-			}
-		}
-
-
-		/**
-		 * Returns an element at the given index.
-		 *
-		 * @param index the index of the element
-		 * @return the element of the array at the given index
-		 */
-		virtual Object* get(size_t index) {
-			assert(index < capacity);
-			return array[index];
-		}
-		
-		/**
-		 * @brief Does this equal other?
-		 * 
-		 * @param other the other Object to compare
-		 * @return true if other equals this
-		 * @return false if other does not equal this
-		 */
-		bool equals(Object* other) {
-			FixedArray* o = dynamic_cast<FixedArray*>(other);
-			if (!o) return false;
-			else if (o->used != used) return false;
-			for (int i = 0; i < used; i++) {
-				if (!array[i]->equals(o->get(i))) {
-					return false;
-				}
-			}
-			return true;
-		}
+template <class T, char Tag>
+struct PodArrayTraits {
+	static const char TAG = Tag;
+	static const bool POD = true;
+	typedef FixedArray<T> Chunk;
 
-		/**
-		 * Pushes the given item to the end of this array.
-		 *
-		 * @param item the given item to be added to the end of this array
-		 */
-		virtual void pushBack(Object* item) {
-			assert(used < capacity);
-			array[used] = item;
-			used += 1;
-		}
+	static bool equal(T a, T b) { return a == b; }
+};
 
-		void set(size_t index, Object* item) {
-			assert(index < capacity);
-			array[index] = item;
-		}
+template <> struct ArrayTraits<int> : PodArrayTraits<int, 'I'> {};
+template <> struct ArrayTraits<float> : PodArrayTraits<float, 'F'> {};
+template <> struct ArrayTraits<bool> : PodArrayTraits<bool, 'B'> {};
+template <> struct ArrayTraits<char> : PodArrayTraits<char, 'C'> {};
 
-		int indexOf(Object* item) {
-			assert(item != nullptr);
-			for (int i = 0; i < capacity; i += 1) {
-				if (item->equals(array[i])) {
-					return i;
-				}
-			}
-			return -1;
-		}
+template <>
+struct ArrayTraits<Object*> {
+	static const bool POD = false;
 
-        void removeAndSwitch(int index) {
-            set(index, get(used - 1));
-            set(used - 1, nullptr);
-            used -= 1;
-        }
+	static bool equal(Object* a, Object* b) { return a == b || (a != nullptr && a->equals(b)); }
+};
 
+template <>
+struct ArrayTraits<String*> {
+	static const char TAG = 'S';
+	static const bool POD = false;
+	typedef FixedStrArray Chunk;
 
-		/**
-		 * The destructor of this array.
-		 */
-		virtual ~FixedArray() {
-			delete[] array;
-		}
+	static bool equal(String* a, String* b) { return a == b || (a != nullptr && a->equals(b)); }
 };
 
 /**
- * Represents an array of ints.
+ * Represents an array of a fixed number of Ts. Elements live in one pooled
+ * block; get is a plain, unchecked load so loops over a chunk inline down to
+ * array accesses. The array does not own what its elements point to.
  */
-class FixedIntArray : public Object {
+template <class T>
+class FixedArray : public Object, public Pooled {
 	public:
-		int* array;
+		T* array;
 		size_t used;
 		size_t capacity;
 
@@ -135,176 +74,45 @@ class FixedIntArray : public Object {
 		/**
 		 * Default constructor of this array.
 		 */
-		FixedIntArray() : Object() {
-			used = 0;
-			capacity = 1;
-			array = new int[1];
-		}
+		FixedArray() : FixedArray(1) {}
 
 
 		/**
-		 * Constructor of this array of Object.
+		 * Constructor of this array.
 		 *
 		 * @param size the base size of this array
 		 */
-		FixedIntArray(size_t size) : Object() {
+		FixedArray(size_t size) : Object() {
 			used = 0;
 			capacity = size;
-			array = new int[size];
-		}
-
-		FixedIntArray(FixedIntArray& from) : Object() {
-			used = from.used;
-			capacity = from.capacity;
-			array = new int[capacity];
-			for (int i = 0; i < used; i += 1) {
-				array[i] = from.get(i);
-			}
-		}
-
-		FixedIntArray* clone() {
-		    return new FixedIntArray(*this);
-		}
-
-
-		/**
-		 * Returns an element at the given index.
-		 *
-		 * @param index the index of the element
-		 * @return the element of the array at the given index
-		 */
-		virtual int get(size_t index) {
-			assert(index < capacity);
-			return array[index];
-		}
-		
-		/**
-		 * @brief Does this equal other?
-		 * 
-		 * @param other the other Object to compare
-		 * @return true if other equals this
-		 * @return false if other does not equal this
-		 */
-		bool equals(Object* other) {
-			FixedIntArray* o = dynamic_cast<FixedIntArray*>(other);
-			if (!o) return false;
-			else if (o->used != used) return false;
-			for (int i = 0; i < used; i++) {
-				if (array[i] != o->get(i)) {
-					return false;
-				}
+			array = static_cast<T*>(Pool::alloc(capacity * sizeof(T)));
+			for (size_t i = 0; i < capacity; i += 1) {
+				array[i] = T();
 			}
-			return true;
-		}
-
-		/**
-		 * Pushes the given item to the end of this array.
-		 *
-		 * @param item the given item to be added to the end of this array
-		 */
-		virtual void pushBack(int item) {
-			assert(used < capacity);
-			array[used] = item;
-			used += 1;
-		}
-
-		/**
-		 * @brief sets the element in this array to the item
-		 * 
-		 * @param index 
-		 * @param item 
-		 */
-		void set(size_t index, int item) {
-			assert(index < capacity);
-			array[index] = item;
 		}
 
-		/**
-		 * @brief Returns the index of the item. Returns -1 if not there.
-		 * 
-		 * @param item 
-		 * @return int 
-		 */
-		int indexOf(int item) {
-			for (int i = 0; i < used; i += 1) {
-				if (item == array[i]) {
-					return i;
-				}
-			}
-			return -1;
-		}
-
-        void removeAndSwitch(int index) {
-            set(index, get(used - 1));
-            set(used - 1, 0);
-            used -= 1;
-        }
-
-
-		/**
-		 * The destructor of this array.
-		 */
-		virtual ~FixedIntArray() {
-			delete[] array;
-		}
-};
-
-/**
- * Represents an array of chars.
- */
-class FixedCharArray : public Object {
-	public:
-		char* array;
-		size_t used;
-		size_t capacity;
-
-
-		/**
-		 * Default constructor of this array.
-		 */
-		FixedCharArray() : Object() {
-			used = 0;
-			capacity = 1;
-			array = new char[1];
-		}
-
-		FixedCharArray(FixedCharArray& from) : Object() {
+		FixedArray(FixedArray& from) : Object() {
 			used = from.used;
 			capacity = from.capacity;
-			array = new char[capacity];
-			for (int i = 0; i < used; i += 1) {
-				array[i] = from.get(i);
-			}
+			array = static_cast<T*>(Pool::alloc(capacity * sizeof(T)));
+			memcpy(array, from.array, used * sizeof(T));
 		}
 
-
-		/**
-		 * Constructor of this array of Object.
-		 *
-		 * @param size the base size of this array
-		 */
-		FixedCharArray(size_t size) : Object() {
-			used = 0;
-			capacity = size;
-			array = new char[size];
+		FixedArray* clone() {
+			return new FixedArray(*this);
 		}
 
-        FixedCharArray* clone() {
-            return new FixedCharArray(*this);
-        }
-
 
 		/**
-		 * Returns an element at the given index.
+		 * Returns an element at the given index; index must be below capacity.
 		 *
 		 * @param index the index of the element
 		 * @return the element of the array at the given index
 		 */
-		virtual char get(size_t index) {
-			assert(index < capacity);
+		T get(size_t index) {
 			return array[index];
 		}
-		
+
 		/**
 		 * @brief Does this equal other?
 		 * 
@@ -313,11 +121,11 @@ class FixedCharArray : public Object {
 		 * @return false if other does not equal this
 		 */
 		bool equals(Object* other) {
-			FixedCharArray* o = dynamic_cast<FixedCharArray*>(other);
+			FixedArray* o = dynamic_cast<FixedArray*>(other);
 			if (!o) return false;
 			else if (o->used != used) return false;
-			for (int i = 0; i < used; i++) {
-				if (array[i] != o->get(i)) {
+			for (size_t i = 0; i < used; i++) {
+				if (!ArrayTraits<T>::equal(array[i], o->array[i])) {
 					return false;
 				}
 			}
@@ -329,7 +137,7 @@ class FixedCharArray : public Object {
 		 *
 		 * @param item the given item to be added to the end of this array
 		 */
-		virtual void pushBack(char item) {
+		void pushBack(T item) {
 			assert(used < capacity);
 			array[used] = item;
 			used += 1;
@@ -341,130 +149,23 @@ class FixedCharArray : public Object {
 		 * @param index 
 		 * @param item 
 		 */
-		void set(size_t index, char item) {
+		void set(size_t index, T item) {
 			assert(index < capacity);
 			array[index] = item;
 		}
 
 		/**
-		 * @brief Returns the index of the item. Returns -1 if not there.
-		 * 
-		 * @param item 
-		 * @return int 
-		 */
-		int indexOf(char item) {
-			for (int i = 0; i < used; i += 1) {
-				if (item == array[i]) {
-					return i;
-				}
-			}
-			return -1;
-		}
-
-
-		/**
-		 * The destructor of this array.
-		 */
-		virtual ~FixedCharArray() {
-			delete[] array;
-		}
-};
-
-/**
- * Represents an array of bools.
- */
-class FixedBoolArray : public Object {
-	public:
-		bool* array;
-		size_t used;
-		size_t capacity;
-
-
-		/**
-		 * Default constructor of this array.
-		 */
-		FixedBoolArray() : Object() {
-			used = 0;
-			capacity = 1;
-			array = new bool[1];
-		}
-
-
-		/**
-		 * Constructor of this array of Object.
-		 *
-		 * @param size the base size of this array
-		 */
-		FixedBoolArray(size_t size) : Object() {
-			used = 0;
-			capacity = size;
-			array = new bool[size];
-		}
-
-		FixedBoolArray(FixedBoolArray& from) : Object() {
-			used = from.used;
-			capacity = from.capacity;
-			array = new bool[capacity];
-			for (int i = 0; i < used; i += 1) {
-				array[i] = from.get(i);
-			}
-		}
-
-        FixedBoolArray* clone() {
-            return new FixedBoolArray(*this);
-        }
-
-
-		/**
-		 * Returns an element at the given index.
-		 *
-		 * @param index the index of the element
-		 * @return the element of the array at the given index
-		 */
-		virtual bool get(size_t index) {
-			assert(index < capacity);
-			return array[index];
-		}
-		
-		/**
-		 * @brief Does this equal other?
-		 * 
-		 * @param other the other Object to compare
-		 * @return true if other equals this
-		 * @return false if other does not equal this
-		 */
-		bool equals(Object* other) {
-			FixedBoolArray* o = dynamic_cast<FixedBoolArray*>(other);
-			if (!o) return false;
-			else if (o->used != used) return false;
-			for (int i = 0; i < used; i++) {
-				if (array[i] != o->get(i)) {
-					return false;
-				}
-			}
-			return true;
-		}
-
-		/**
-		 * Pushes the given item to the end of this array.
-		 *
-		 * @param item the given item to be added to the end of this array
+		 * @brief Returns the capacity of this array
 		 */
-		virtual void pushBack(bool item) {
-			assert(used < capacity);
-			array[used] = item;
-			used += 1;
+		size_t size() {
+			return capacity;
 		}
 
 		/**
-		 * @brief sets the element in this array to the item
-		 * 
-		 * @param index 
-		 * @param item 
+		 * @brief Returns the number of elements pushed so far
 		 */
-		void set(size_t index, bool item) {
-			assert(index < capacity);
-			array[index] = item;
+		size_t numElements() {
+			return used;
 		}
 
 		/**
@@ -473,157 +174,48 @@ class FixedBoolArray : public Object {
 		 * @param item 
 		 * @return int 
 		 */
-		int indexOf(bool item) {
-			for (int i = 0; i < used; i += 1) {
-				if (item == array[i]) {
+		int indexOf(T item) {
+			for (size_t i = 0; i < used; i += 1) {
+				if (ArrayTraits<T>::equal(item, array[i])) {
 					return i;
 				}
 			}
 			return -1;
 		}
 
-
-		/**
-		 * The destructor of this array.
-		 */
-		virtual ~FixedBoolArray() {
-			delete[] array;
-		}
-};
-
-/**
- * Represents an array of floats.
- */
-class FixedFloatArray : public Object {
-	public:
-		float* array;
-		size_t used;
-		size_t capacity;
-
-
-		/**
-		 * Default constructor of this array.
-		 */
-		FixedFloatArray() : Object() {
-			used = 0;
-			capacity = 1;
-			array = new float[1];
-		}
-
-
-		/**
-		 * Constructor of this array of Object.
-		 *
-		 * @param size the base size of this array
-		 */
-		FixedFloatArray(size_t size) : Object() {
-			used = 0;
-			capacity = size;
-			array = new float[size];
-		}
-
-		FixedFloatArray(FixedFloatArray& from) : Object() {
-			used = from.used;
-			capacity = from.capacity;
-			array = new float[capacity];
-			for (int i = 0; i < used; i += 1) {
-				array[i] = from.get(i);
-			}
-		}
-
-        FixedFloatArray* clone() {
-            return new FixedFloatArray(*this);
+        void removeAndSwitch(int index) {
+            set(index, get(used - 1));
+            set(used - 1, T());
+            used -= 1;
         }
 
 
-		/**
-		 * Returns an element at the given index.
-		 *
-		 * @param index the index of the element
-		 * @return the element of the array at the given index
-		 */
-		virtual float get(size_t index) {
-			assert(index < capacity);
-			return array[index];
-		}
-		
-		/**
-		 * @brief Does this equal other?
-		 * 
-		 * @param other the other Object to compare
-		 * @return true if other equals this
-		 * @return false if other does not equal this
-		 */
-		bool equals(Object* other) {
-			FixedFloatArray* o = dynamic_cast<FixedFloatArray*>(other);
-			if (!o) return false;
-			else if (o->used != used) return false;
-			for (int i = 0; i < used; i++) {
-				if (array[i] != o->get(i)) {
-					return false;
-				}
-			}
-			return true;
-		}
-
-		/**
-		 * Pushes the given item to the end of this array.
-		 *
-		 * @param item the given item to be added to the end of this array
-		 */
-		virtual void pushBack(float item) {
-			assert(used < capacity);
-			array[used] = item;
-			used += 1;
-		}
-
-		/**
-		 * @brief sets the element in this array to the item
-		 * 
-		 * @param index 
-		 * @param item 
-		 */
-		void set(size_t index, float item) {
-			assert(index < capacity);
-			array[index] = item;
-		}
-
-		/**
-		 * @brief Returns the index of the item. Returns -1 if not there.
-		 * 
-		 * @param item 
-		 * @return int 
-		 */
-		int indexOf(float item) {
-			for (int i = 0; i < used; i += 1) {
-				if (item == array[i]) {
-					return i;
-				}
-			}
-			return -1;
-		}
-
-
 		/**
 		 * The destructor of this array.
 		 */
-		virtual ~FixedFloatArray() {
-			delete[] array;
+		~FixedArray() {
+			Pool::free(array, capacity * sizeof(T));
 		}
 };
 
+typedef FixedArray<Object*> FixedObjArray;
+typedef FixedArray<int> FixedIntArray;
+typedef FixedArray<char> FixedCharArray;
+typedef FixedArray<bool> FixedBoolArray;
+typedef FixedArray<float> FixedFloatArray;
+
 /**
  * Represents an array of Strings.
  */
-class FixedStrArray : public Object {
+class FixedStrArray : public Object, public Pooled {
 	public:
-		FixedArray* array;
+		FixedObjArray* array; // owns the Strings
 
 		/**
 		 * Default constructor of this array.
 		 */
 		FixedStrArray() : Object() {
-			array = new FixedArray();
+			array = new FixedObjArray();
 		}
 
 
@@ -633,13 +225,12 @@ class FixedStrArray : public Object {
 		* @param size the base size of this array
 		*/
 		FixedStrArray(size_t size) : Object() {
-			array = new FixedArray(size);
+			array = new FixedObjArray(size);
 		}
 
 		FixedStrArray(FixedStrArray& from) : FixedStrArray(from.size()) {
-			for (int i = 0; i < from.size(); i += 1) {
-				String* str = from.get(i);
-				set(i, new String(str->c_str()));
+			for (size_t i = 0; i < from.numElements(); i += 1) {
+				pushBack(from.get(i));
 			}
 		}
 
@@ -654,9 +245,8 @@ class FixedStrArray : public Object {
 		 * @param index the index of the element
 		 * @return the element of the array at the given index
 		 */
-		virtual String* get(size_t index) {
-			String* element = dynamic_cast <String *> (array->get(index));
-			return element;
+		String* get(size_t index) {
+			return static_cast<String*>(array->get(index));
 		}
 
 		/**
@@ -667,7 +257,8 @@ class FixedStrArray : public Object {
 		 * @return false if other does not equal this
 		 */
 		bool equals(Object* other) {
-			return array->equals(other);
+			FixedStrArray* o = dynamic_cast<FixedStrArray*>(other);
+			return o != nullptr && array->equals(o->array);
 		}
 
 		/**
@@ -675,7 +266,7 @@ class FixedStrArray : public Object {
 		 *
 		 * @param item the given item to be added to the end of this array
 		 */
-		virtual void pushBack(String* item) {
+		void pushBack(String* item) {
 			array->pushBack(item->clone());
 		}
 
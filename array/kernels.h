@@ -0,0 +1,251 @@
+#pragma once
+
+#include <climits>
+#include <limits>
+#include <stddef.h>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNELS_X86 1
+#endif
+
+/** Sum, min, max and count of a run of ints; partial results merge. */
+struct IntAgg {
+    int64_t sum = 0;
+    int min = INT_MAX;
+    int max = INT_MIN;
+    size_t count = 0;
+
+    void merge(const IntAgg& other) {
+        sum += other.sum;
+        if (other.min < min) min = other.min;
+        if (other.max > max) max = other.max;
+        count += other.count;
+    }
+
+    double mean() const { return count == 0 ? 0 : (double) sum / count; }
+};
+
+/** Sum (in double), min, max and count of a run of floats; partial results merge. */
+struct FloatAgg {
+    double sum = 0;
+    float min = std::numeric_limits<float>::infinity();
+    float max = -std::numeric_limits<float>::infinity();
+    size_t count = 0;
+
+    void merge(const FloatAgg& other) {
+        sum += other.sum;
+        if (other.min < min) min = other.min;
+        if (other.max > max) max = other.max;
+        count += other.count;
+    }
+
+    double mean() const { return count == 0 ? 0 : sum / count; }
+};
+
+/** The aggregate of a column of Ts and the name of the task that computes it per node. */
+template <class T>
+struct KernelAgg;
+
+template <> struct KernelAgg<int> {
+    typedef IntAgg Agg;
+    static constexpr const char* TASK = "aggregate-int";
+};
+
+template <> struct KernelAgg<float> {
+    typedef FloatAgg Agg;
+    static constexpr const char* TASK = "aggregate-float";
+};
+
+/**
+ * Aggregate kernels over the raw buffers of numeric chunks. Each comes as
+ * AVX2, SSE4.1 and plain C++; the best one the CPU supports is picked the
+ * first time it is called. Sums of ints are kept in 64 bit lanes so they
+ * cannot overflow, sums of floats in double.
+ */
+class Kernels {
+    public:
+        typedef void (*IntKernel)(const int*, size_t, IntAgg&);
+        typedef void (*FloatKernel)(const float*, size_t, FloatAgg&);
+
+        /** Folds the n values at v into acc. */
+        static void aggregate(const int* v, size_t n, IntAgg& acc) {
+            static IntKernel kernel = pick_int_();
+            kernel(v, n, acc);
+        }
+
+        static void aggregate(const float* v, size_t n, FloatAgg& acc) {
+            static FloatKernel kernel = pick_float_();
+            kernel(v, n, acc);
+        }
+
+        /** The instruction set the kernels run with on this CPU. */
+        static const char* isa() {
+#ifdef KERNELS_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) return "avx2";
+            if (__builtin_cpu_supports("sse4.1")) return "sse4.1";
+#endif
+            return "scalar";
+        }
+
+        static IntKernel pick_int_() {
+#ifdef KERNELS_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) return aggregate_avx2_;
+            if (__builtin_cpu_supports("sse4.1")) return aggregate_sse41_;
+#endif
+            return aggregate_scalar_;
+        }
+
+        static FloatKernel pick_float_() {
+#ifdef KERNELS_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) return aggregate_avx2_;
+            if (__builtin_cpu_supports("sse4.1")) return aggregate_sse41_;
+#endif
+            return aggregate_scalar_;
+        }
+
+        static void aggregate_scalar_(const int* v, size_t n, IntAgg& acc) {
+            int64_t sum = 0;
+            int min = acc.min;
+            int max = acc.max;
+            for (size_t i = 0; i < n; i += 1) {
+                sum += v[i];
+                if (v[i] < min) min = v[i];
+                if (v[i] > max) max = v[i];
+            }
+            acc.sum += sum;
+            acc.min = min;
+            acc.max = max;
+            acc.count += n;
+        }
+
+        static void aggregate_scalar_(const float* v, size_t n, FloatAgg& acc) {
+            double sum = 0;
+            float min = acc.min;
+            float max = acc.max;
+            for (size_t i = 0; i < n; i += 1) {
+                sum += v[i];
+                if (v[i] < min) min = v[i];
+                if (v[i] > max) max = v[i];
+            }
+            acc.sum += sum;
+            acc.min = min;
+            acc.max = max;
+            acc.count += n;
+        }
+
+#ifdef KERNELS_X86
+        __attribute__((target("avx2")))
+        static void aggregate_avx2_(const int* v, size_t n, IntAgg& acc) {
+            __m256i lo = _mm256_setzero_si256();
+            __m256i hi = _mm256_setzero_si256();
+            __m256i min = _mm256_set1_epi32(acc.min);
+            __m256i max = _mm256_set1_epi32(acc.max);
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + i));
+                min = _mm256_min_epi32(min, x);
+                max = _mm256_max_epi32(max, x);
+                lo = _mm256_add_epi64(lo, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(x)));
+                hi = _mm256_add_epi64(hi, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(x, 1)));
+            }
+            int64_t sums[4];
+            int mins[8];
+            int maxs[8];
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(sums), _mm256_add_epi64(lo, hi));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(mins), min);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(maxs), max);
+            fold_(sums, 4, mins, maxs, 8, acc);
+            aggregate_scalar_(v + i, n - i, acc);
+            acc.count += i;
+        }
+
+        __attribute__((target("sse4.1")))
+        static void aggregate_sse41_(const int* v, size_t n, IntAgg& acc) {
+            __m128i lo = _mm_setzero_si128();
+            __m128i hi = _mm_setzero_si128();
+            __m128i min = _mm_set1_epi32(acc.min);
+            __m128i max = _mm_set1_epi32(acc.max);
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + i));
+                min = _mm_min_epi32(min, x);
+                max = _mm_max_epi32(max, x);
+                lo = _mm_add_epi64(lo, _mm_cvtepi32_epi64(x));
+                hi = _mm_add_epi64(hi, _mm_cvtepi32_epi64(_mm_srli_si128(x, 8)));
+            }
+            int64_t sums[2];
+            int mins[4];
+            int maxs[4];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), _mm_add_epi64(lo, hi));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(mins), min);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(maxs), max);
+            fold_(sums, 2, mins, maxs, 4, acc);
+            aggregate_scalar_(v + i, n - i, acc);
+            acc.count += i;
+        }
+
+        __attribute__((target("avx2")))
+        static void aggregate_avx2_(const float* v, size_t n, FloatAgg& acc) {
+            __m256d lo = _mm256_setzero_pd();
+            __m256d hi = _mm256_setzero_pd();
+            __m256 min = _mm256_set1_ps(acc.min);
+            __m256 max = _mm256_set1_ps(acc.max);
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                __m256 x = _mm256_loadu_ps(v + i);
+                min = _mm256_min_ps(min, x);
+                max = _mm256_max_ps(max, x);
+                lo = _mm256_add_pd(lo, _mm256_cvtps_pd(_mm256_castps256_ps128(x)));
+                hi = _mm256_add_pd(hi, _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)));
+            }
+            double sums[4];
+            float mins[8];
+            float maxs[8];
+            _mm256_storeu_pd(sums, _mm256_add_pd(lo, hi));
+            _mm256_storeu_ps(mins, min);
+            _mm256_storeu_ps(maxs, max);
+            fold_(sums, 4, mins, maxs, 8, acc);
+            aggregate_scalar_(v + i, n - i, acc);
+            acc.count += i;
+        }
+
+        __attribute__((target("sse4.1")))
+        static void aggregate_sse41_(const float* v, size_t n, FloatAgg& acc) {
+            __m128d lo = _mm_setzero_pd();
+            __m128d hi = _mm_setzero_pd();
+            __m128 min = _mm_set1_ps(acc.min);
+            __m128 max = _mm_set1_ps(acc.max);
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m128 x = _mm_loadu_ps(v + i);
+                min = _mm_min_ps(min, x);
+                max = _mm_max_ps(max, x);
+                lo = _mm_add_pd(lo, _mm_cvtps_pd(x));
+                hi = _mm_add_pd(hi, _mm_cvtps_pd(_mm_movehl_ps(x, x)));
+            }
+            double sums[2];
+            float mins[4];
+            float maxs[4];
+            _mm_storeu_pd(sums, _mm_add_pd(lo, hi));
+            _mm_storeu_ps(mins, min);
+            _mm_storeu_ps(maxs, max);
+            fold_(sums, 2, mins, maxs, 4, acc);
+            aggregate_scalar_(v + i, n - i, acc);
+            acc.count += i;
+        }
+#endif
+
+        /** Folds the lanes of a vector kernel into acc. */
+        template <class S, class V, class Agg>
+        static void fold_(const S* sums, size_t sumLanes, const V* mins, const V* maxs, size_t lanes, Agg& acc) {
+            for (size_t i = 0; i < sumLanes; i += 1) acc.sum += sums[i];
+            for (size_t i = 0; i < lanes; i += 1) {
+                if (mins[i] < acc.min) acc.min = mins[i];
+                if (maxs[i] > acc.max) acc.max = maxs[i];
+            }
+        }
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cmath>
+#include <stdint.h>
+#include <string.h>
+#include "zones.h"
+
+/** The 64 bit hash of a value of a column, as sketches and indexes take it. */
+struct ValueHash {
+    static uint64_t of(int v) {
+        return mix(Zone::hash(reinterpret_cast<const char*>(&v), sizeof(v)));
+    }
+
+    /** Floats hash by their bits, with -0 taken as 0 so that the two hash alike. */
+    static uint64_t of(float v) {
+        if (v == 0) v = 0;
+        return mix(Zone::hash(reinterpret_cast<const char*>(&v), sizeof(v)));
+    }
+
+    static uint64_t of(bool v) {
+        char c = v ? 1 : 0;
+        return mix(Zone::hash(&c, 1));
+    }
+
+    static uint64_t of(const char* v) {
+        return mix(Zone::hash(v, strlen(v)));
+    }
+
+    static uint64_t of(String* v) {
+        return mix(Zone::hash(v->c_str(), v->size()));
+    }
+
+    /** Spreads the bits of an FNV hash, whose high bits barely move over short values. */
+    static uint64_t mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+};
+
+/**
+ * A HyperLogLog estimate of the number of distinct values seen: 2^P
+ * registers, each the longest run of leading zeros among the hashes that
+ * pick it. The estimate is off by about 1.04 / sqrt(2^P), 1.6% here.
+ * Sketches of different values merge into the sketch of them all.
+ */
+struct HyperLogLog {
+    static const size_t P = 12;
+    static const size_t REGISTERS = (size_t) 1 << P;
+
+    uint8_t registers[REGISTERS] = {};
+
+    void add(uint64_t h) {
+        size_t reg = (size_t) (h >> (64 - P));
+        uint64_t rest = (h << P) | ((uint64_t) 1 << (P - 1));
+        uint8_t rank = (uint8_t) (__builtin_clzll(rest) + 1);
+        if (rank > registers[reg]) registers[reg] = rank;
+    }
+
+    void merge(const HyperLogLog& other) {
+        for (size_t i = 0; i < REGISTERS; i += 1) {
+            if (other.registers[i] > registers[i]) registers[i] = other.registers[i];
+        }
+    }
+
+    double estimate() const {
+        double m = REGISTERS;
+        double sum = 0;
+        size_t zeros = 0;
+        for (size_t i = 0; i < REGISTERS; i += 1) {
+            sum += std::ldexp(1.0, -registers[i]);
+            if (registers[i] == 0) zeros += 1;
+        }
+        double raw = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+        if (raw <= 2.5 * m && zeros > 0) return m * std::log(m / zeros); // few values: count the empty registers
+        return raw;
+    }
+};
+
+/**
+ * A count-min sketch of how often each value was seen: DEPTH rows of
+ * WIDTH counters, a value adding one to a counter in every row. A count
+ * read back is never too low, and too high by at most e / WIDTH of all
+ * the values seen, in all but about 1 / e^DEPTH of the cases. Sketches of
+ * different values merge into the sketch of them all.
+ */
+struct CountMin {
+    static const size_t DEPTH = 4;
+    static const size_t WIDTH = 2048;
+
+    uint32_t counts[DEPTH][WIDTH] = {};
+
+    void add(uint64_t h) {
+        for (size_t row = 0; row < DEPTH; row += 1) {
+            counts[row][slot_(h, row)] += 1;
+        }
+    }
+
+    void merge(const CountMin& other) {
+        for (size_t row = 0; row < DEPTH; row += 1) {
+            for (size_t i = 0; i < WIDTH; i += 1) {
+                counts[row][i] += other.counts[row][i];
+            }
+        }
+    }
+
+    uint32_t estimate(uint64_t h) const {
+        uint32_t least = counts[0][slot_(h, 0)];
+        for (size_t row = 1; row < DEPTH; row += 1) {
+            uint32_t n = counts[row][slot_(h, row)];
+            if (n < least) least = n;
+        }
+        return least;
+    }
+
+    static size_t slot_(uint64_t h, size_t row) {
+        uint32_t lo = (uint32_t) h;
+        uint32_t hi = (uint32_t) (h >> 32) | 1;
+        return (size_t) ((lo + row * hi) % WIDTH);
+    }
+};
+
+/** The sketches of a column: how many distinct values it holds, and how often each one. */
+struct ColumnSketch {
+    HyperLogLog distinct;
+    CountMin frequency;
+    uint64_t count = 0;
+
+    void add(uint64_t h) {
+        distinct.add(h);
+        frequency.add(h);
+        count += 1;
+    }
+
+    void merge(const ColumnSketch& other) {
+        distinct.merge(other.distinct);
+        frequency.merge(other.frequency);
+        count += other.count;
+    }
+
+    double distinct_values() const {
+        return distinct.estimate();
+    }
+
+    /** About how many times v occurs; never fewer than it does. */
+    template <class V>
+    uint32_t count_of(V v) const {
+        return frequency.estimate(ValueHash::of(v));
+    }
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <limits>
+#include <stdint.h>
+#include "../util/string.h"
+
+/**
+ * A summary of one chunk of a column, so scans can skip the chunks a
+ * predicate rules out without fetching them: the least and greatest of a
+ * chunk of numbers (bools and chars count as numbers), and for strings a
+ * 64 bit fingerprint with the bit of every value's hash set. A zone with
+ * count 0 is not known and rules nothing out.
+ */
+struct Zone {
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    uint64_t mask = 0;
+    uint64_t count = 0;
+
+    void add(int v) { add_(v); }
+    void add(float v) { add_(v); }
+    void add(bool v) { add_(v ? 1 : 0); }
+    void add(char v) { add_(v); }
+
+    void add(String* v) {
+        mask |= bit(v->c_str(), v->size());
+        count += 1;
+    }
+
+    /** Whether the chunk may hold a number in [lo, hi]. */
+    bool may_overlap(double lo, double hi) const {
+        return count == 0 || (lo <= max && min <= hi);
+    }
+
+    /** Whether the chunk may hold the string of len characters at s. */
+    bool may_hold(const char* s, size_t len) const {
+        return count == 0 || (mask & bit(s, len)) != 0;
+    }
+
+    /** The fingerprint bit of a string: the top 6 bits of its hash. */
+    static uint64_t bit(const char* s, size_t len) {
+        return (uint64_t) 1 << (hash(s, len) >> 58);
+    }
+
+    /** The 64 bit FNV-1a hash of a string. */
+    static uint64_t hash(const char* s, size_t len) {
+        uint64_t h = 14695981039346656037ull;
+        for (size_t i = 0; i < len; i += 1) {
+            h = (h ^ (unsigned char) s[i]) * 1099511628211ull;
+        }
+        return h;
+    }
+
+    void add_(double v) {
+        if (v < min) min = v;
+        if (v > max) max = v;
+        count += 1;
+    }
+};
+
+/**
+ * A Bloom filter over the strings of one chunk: BITS bits, HASHES of them
+ * set per string, taken from the two halves of its hash. Sized for a chunk
+ * of 50 strings it wrongly lets a string through about one time in a
+ * hundred, where the 64 bit fingerprint of a Zone soon fills up. An empty
+ * filter holds nothing.
+ */
+struct Bloom {
+    static const size_t BITS = 512;
+    static const size_t HASHES = 4;
+
+    uint64_t words[BITS / 64] = {};
+
+    void add(const char* s, size_t len) {
+        uint64_t h = Zone::hash(s, len);
+        for (size_t i = 0; i < HASHES; i += 1) {
+            size_t bit = probe_(h, i);
+            words[bit / 64] |= (uint64_t) 1 << (bit % 64);
+        }
+    }
+
+    bool may_hold(const char* s, size_t len) const {
+        uint64_t h = Zone::hash(s, len);
+        for (size_t i = 0; i < HASHES; i += 1) {
+            size_t bit = probe_(h, i);
+            if ((words[bit / 64] & ((uint64_t) 1 << (bit % 64))) == 0) return false;
+        }
+        return true;
+    }
+
+    static size_t probe_(uint64_t h, size_t i) {
+        uint32_t lo = (uint32_t) h;
+        uint32_t hi = (uint32_t) (h >> 32) | 1;
+        return (size_t) ((lo + i * hi) % BITS);
+    }
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "../array/array.h"
+#include "row.h"
+
+/*************************************************************************
+ * Batch::
+ * One chunk's worth of rows of a data frame, handed to a Reader column by
+ * column: the chunk of each column plus the number of rows in use. The
+ * chunks are on loan for the visit and must not be retained or changed.
+ */
+class Batch : public Object {
+    public:
+        size_t rows;    // the rows in this batch; the last one of a frame may be short
+        size_t start;   // the index in the frame of the first row
+        size_t width;
+        char* types;    // owned; one of 'I', 'F', 'B', 'S' per column
+        Object** cols;  // owned array; the chunks themselves are on loan, nullptr for unread columns
+        Row* row_;      // owned; what row() fills in
+
+        Batch(size_t width_var) : Object() {
+            rows = 0;
+            start = 0;
+            width = width_var;
+            types = new char[width];
+            cols = new Object*[width];
+            for (size_t col = 0; col < width; col += 1) {
+                cols[col] = nullptr;
+            }
+            row_ = new Row(width);
+        }
+
+        ~Batch() {
+            delete[] types;
+            delete[] cols;
+            delete row_;
+        }
+
+        /** The chunk of column col; its first rows elements are this batch's.
+         *  The column must be one the map was asked to read. */
+        FixedIntArray* int_col(size_t col) {
+            assert(types[col] == 'I' && cols[col] != nullptr);
+            return static_cast<FixedIntArray*>(cols[col]);
+        }
+
+        FixedFloatArray* float_col(size_t col) {
+            assert(types[col] == 'F' && cols[col] != nullptr);
+            return static_cast<FixedFloatArray*>(cols[col]);
+        }
+
+        FixedBoolArray* bool_col(size_t col) {
+            assert(types[col] == 'B' && cols[col] != nullptr);
+            return static_cast<FixedBoolArray*>(cols[col]);
+        }
+
+        FixedStrArray* str_col(size_t col) {
+            assert(types[col] == 'S' && cols[col] != nullptr);
+            return static_cast<FixedStrArray*>(cols[col]);
+        }
+
+        /** Row i of the batch, in a Row that is reused by the next call.
+         *  Columns that were not read are left as they were. */
+        Row& row(size_t i) {
+            for (size_t col = 0; col < width; col += 1) {
+                if (cols[col] == nullptr) {
+                    continue;
+                } else if (types[col] == 'I') {
+                    row_->set(col, int_col(col)->get(i));
+                } else if (types[col] == 'F') {
+                    row_->set(col, float_col(col)->get(i));
+                } else if (types[col] == 'B') {
+                    row_->set(col, bool_col(col)->get(i));
+                } else {
+                    row_->set(col, str_col(col)->get(i));
+                }
+            }
+            row_->set_idx(start + i);
+            return *row_;
+        }
+};
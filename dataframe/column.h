@@ -53,89 +53,79 @@ class DistColumn : public Object {
             assert(false);
         }
 
-};
+        /** How the column's values are laid out in chunks; see DistEffArr. */
+        virtual size_t num_chunks() {
+            assert(false);
+        }
 
-/*************************************************************************
- * DistIntColumn::
- * Holds int values in a distributed network.
- */
-class DistIntColumn : public DistColumn {
-    public:
-        DistEffIntArr* array;
+        virtual size_t chunk_rows(size_t chunkIdx) {
+            assert(false);
+        }
 
-        DistIntColumn(String *id_var, Distributable *kvStore_var, size_t node, bool get) {
-            locked_ = get ? kvStore_var->get_bool(node, id_var->clone()->concat("-locked")) : false;
-            init_(id_var, kvStore_var, node);
-            array = new DistEffIntArr(id_var, kvStore_var, node, get);
+        virtual size_t chunk_start(size_t chunkIdx) {
+            assert(false);
         }
 
-        /**
-         * @brief get the int at the given index
-         *
-         * @param idx
-         * @return int
-         */
-        int get(size_t idx) {
-            return array->get(idx);
+        virtual size_t chunk_size() {
+            assert(false);
         }
 
-        size_t size() override {
-            return array->numberOfElements;
+        virtual void set_chunk_rows(const std::vector<size_t>& rows) {
+            assert(false);
         }
 
-        void push_back(int val) {
-            array->push_back(val);
+        /** The zone of each chunk, for skipping chunks; see DistEffArr::zone. */
+        virtual Zone zone(size_t chunkIdx) {
+            assert(false);
         }
 
-        void lock() override {
-            locked_ = true;
-            kvStore->put(metadata_node, id->clone()->concat("-locked"), locked_);
-            array->lock();
+        virtual std::string zone_bytes() {
+            assert(false);
         }
 
-        char get_type() override {
-            return 'I';
+        virtual void add_zones(const std::string& bytes) {
+            assert(false);
         }
 
-        /**
-         * @brief return this int column as an int column
-         *
-         * @return IntColumn*
-         */
-        DistIntColumn* as_int() override {
-            return this;
+        /** Whether chunk chunkIdx of a string column may hold the given
+         *  string; see DistEffArr::may_hold. */
+        virtual bool may_hold(size_t chunkIdx, const char* s, size_t len) {
+            assert(false);
         }
 
-        /**
-         * @brief Destroy the Int Column object
-         *
-         */
-        ~DistIntColumn() {
-            delete array;
+        /** Appending to a locked column; see DistEffArr::reopen, commit and at_version. */
+        virtual void reopen() {
+            assert(false);
+        }
+
+        virtual void commit(size_t) {
+            assert(false);
         }
+
+        virtual void at_version(size_t) {
+            assert(false);
+        }
+
 };
 
 /*************************************************************************
- * DistBoolColumn::
- * Holds bool values in a distributed network.
+ * DistTypedColumn::
+ * Holds values of type T in a distributed network, in a DistEffArr<T>; the
+ * typed columns below add only their type.
  */
-class DistBoolColumn : public DistColumn {
+template <class T>
+class DistTypedColumn : public DistColumn {
     public:
-        DistEffBoolArr* array;
+        DistEffArr<T>* array;
 
-        DistBoolColumn(String *id_var, Distributable *kvStore_var, size_t node, bool get) {
+        DistTypedColumn(String *id_var, Distributable *kvStore_var, size_t node, bool get) {
             locked_ = get ? kvStore_var->get_bool(node, id_var->clone()->concat("-locked")) : false;
             init_(id_var, kvStore_var, node);
-            array = new DistEffBoolArr(id_var, kvStore_var, node, get);
+            array = new DistEffArr<T>(id_var, kvStore_var, node, get);
         }
 
-        /**
-         * @brief get the int at the given index
-         *
-         * @param idx
-         * @return int
-         */
-        bool get(size_t idx) {
+        /** Returns the value at the given index. */
+        T get(size_t idx) {
             return array->get(idx);
         }
 
@@ -143,67 +133,51 @@ class DistBoolColumn : public DistColumn {
             return array->numberOfElements;
         }
 
-        void push_back(bool val) {
-            array->push_back(val);
+        size_t num_chunks() override {
+            return array->num_chunks();
         }
 
-        void lock() override {
-            locked_ = true;
-            kvStore->put(metadata_node, id->clone()->concat("-locked"), locked_);
-            array->lock();
+        size_t chunk_rows(size_t chunkIdx) override {
+            return array->chunk_rows(chunkIdx);
         }
 
-        char get_type() override {
-            return 'B';
+        size_t chunk_start(size_t chunkIdx) override {
+            return array->chunk_start(chunkIdx);
         }
 
-        /**
-         * @brief throw error since this is an int column
-         *
-         * @return BoolColumn*
-         */
-        DistBoolColumn* as_bool() override {
-            return this;
+        size_t chunk_size() override {
+            return array->chunkSize;
         }
 
-        /**
-         * @brief Destroy the Int Column object
-         *
-         */
-        ~DistBoolColumn() {
-            delete array;
+        void set_chunk_rows(const std::vector<size_t>& rows) override {
+            array->set_chunk_rows(rows);
         }
-};
 
-/*************************************************************************
- * DistFloatColumn::
- * Holds float values in a distributed network.
- */
-class DistFloatColumn : public DistColumn {
-    public:
-        DistEffFloatArr* array;
+        Zone zone(size_t chunkIdx) override {
+            return array->zone(chunkIdx);
+        }
 
-        DistFloatColumn(String *id_var, Distributable *kvStore_var, size_t node, bool get) {
-            locked_ = get ? kvStore_var->get_bool(node, id_var->clone()->concat("-locked")) : false;
-            init_(id_var, kvStore_var, node);
-            array = new DistEffFloatArr(id_var, kvStore_var, node, get);
+        std::string zone_bytes() override {
+            return array->zone_bytes();
         }
 
-        /**
-         * @brief get the int at the given index
-         *
-         * @param idx
-         * @return int
-         */
-        float get(size_t idx) {
-            return array->get(idx);
+        void add_zones(const std::string& bytes) override {
+            array->add_zones(bytes);
         }
 
-        size_t size() override {
-            return array->numberOfElements;
+        void reopen() override {
+            array->reopen();
         }
 
-        void push_back(float val) {
+        void commit(size_t version) override {
+            array->commit(version);
+        }
+
+        void at_version(size_t version) override {
+            array->at_version(version);
+        }
+
+        void push_back(T val) {
             array->push_back(val);
         }
 
@@ -213,86 +187,85 @@ class DistFloatColumn : public DistColumn {
             array->lock();
         }
 
-        char get_type() override {
-            return 'F';
+        ~DistTypedColumn() {
+            delete array;
         }
+};
 
-        /**
-         * @brief throw error since this is an int column
-         *
-         * @return FloatColumn*
-         */
-        DistFloatColumn* as_float() override {
-            return this;
+/*************************************************************************
+ * DistIntColumn::
+ * Holds int values in a distributed network.
+ */
+class DistIntColumn : public DistTypedColumn<int> {
+    public:
+        DistIntColumn(String *id_var, Distributable *kvStore_var, size_t node, bool get)
+                : DistTypedColumn<int>(id_var, kvStore_var, node, get) {}
+
+        char get_type() override {
+            return 'I';
         }
 
-        /**
-         * @brief Destroy the Int Column object
-         *
-         */
-        ~DistFloatColumn() {
-            delete array;
+        DistIntColumn* as_int() override {
+            return this;
         }
 };
 
 /*************************************************************************
- * DistStringColumn::
- * Holds String values in a distributed network.
+ * DistBoolColumn::
+ * Holds bool values in a distributed network.
  */
-class DistStringColumn : public DistColumn {
+class DistBoolColumn : public DistTypedColumn<bool> {
     public:
-        DistEffStrArr* array;
+        DistBoolColumn(String *id_var, Distributable *kvStore_var, size_t node, bool get)
+                : DistTypedColumn<bool>(id_var, kvStore_var, node, get) {}
 
-        DistStringColumn(String *id_var, Distributable *kvStore_var, size_t node, bool get) {
-            locked_ = get ? kvStore_var->get_bool(node, id_var->clone()->concat("-locked")) : false;
-            init_(id_var, kvStore_var, node);
-            array = new DistEffStrArr(id_var, kvStore_var, node, get);
+        char get_type() override {
+            return 'B';
         }
 
-        /**
-         * @brief get the int at the given index
-         *
-         * @param idx
-         * @return int
-         */
-        String* get(size_t idx) {
-            return array->get(idx);
+        DistBoolColumn* as_bool() override {
+            return this;
         }
+};
 
-        size_t size() override {
-            return array->numberOfElements;
+/*************************************************************************
+ * DistFloatColumn::
+ * Holds float values in a distributed network.
+ */
+class DistFloatColumn : public DistTypedColumn<float> {
+    public:
+        DistFloatColumn(String *id_var, Distributable *kvStore_var, size_t node, bool get)
+                : DistTypedColumn<float>(id_var, kvStore_var, node, get) {}
+
+        char get_type() override {
+            return 'F';
         }
 
-        void push_back(String* val) {
-            array->push_back(val);
+        DistFloatColumn* as_float() override {
+            return this;
         }
+};
 
-        void lock() override {
-            locked_ = true;
-            kvStore->put(metadata_node, id->clone()->concat("-locked"), locked_);
-            array->lock();
+/*************************************************************************
+ * DistStringColumn::
+ * Holds String values in a distributed network.
+ */
+class DistStringColumn : public DistTypedColumn<String*> {
+    public:
+        DistStringColumn(String *id_var, Distributable *kvStore_var, size_t node, bool get)
+                : DistTypedColumn<String*>(id_var, kvStore_var, node, get) {}
+
+        bool may_hold(size_t chunkIdx, const char* s, size_t len) override {
+            return array->may_hold(chunkIdx, s, len);
         }
 
         char get_type() override {
             return 'S';
         }
 
-        /**
-         * @brief throw error since this is an int column
-         *
-         * @return StringColumn*
-         */
         DistStringColumn* as_string() override {
             return this;
         }
-
-        /**
-         * @brief Destroy the Int Column object
-         *
-         */
-        ~DistStringColumn() {
-            delete array;
-        }
 };
 
 /**
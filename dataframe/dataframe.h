@@ -1,11 +1,24 @@
 #pragma once
 
+#include <atomic>
+#include <thread>
+#include <string>
+#include <vector>
 #include "../util/object.h"
 #include "schema.h"
 #include "../array/array.h"
 #include "column.h"
 #include "row.h"
 #include "rower.h"
+#include "packer.h"
+#include "predicates.h"
+#include "groupby.h"
+#include "join.h"
+#include "shuffle.h"
+#include "sort.h"
+#include "index.h"
+#include "topk.h"
+#include "plan.h"
 
 class KDStore;
 
@@ -23,11 +36,16 @@ class DistDataFrame : public Object {
         String* id;
         Distributable* kvStore;
         bool locked_;
+        bool appending_;  // between reopen and commit
+        size_t version;   // the commits of appended rows the frame is as of
+        std::string streaming_; // the key of the frame this handle follows as it is written; see KDStore::stream
 
         DistDataFrame(Schema& schema_var, Key* key, Distributable* kvStore_var) {
             id = key->key->clone()->concat("-df");
             kvStore = kvStore_var;
             locked_ = false;
+            appending_ = false;
+            version = 0;
             schema = new DistSchema(schema_var, key, kvStore);
             String* cols_id = id->clone()->concat("-cols");
             columns = new DistEffColArr(schema->types, cols_id, kvStore, key->node, false);
@@ -54,12 +72,22 @@ class DistDataFrame : public Object {
             kvStore = kvStore_var;
             id = key->key->clone();
             id->concat("-df");
+            read_(key);
+        }
+
+        /** Reads the schema, columns and version of the locked frame under key. */
+        void read_(Key* key) {
             schema = new DistSchema(key, kvStore);
             String* cols_id = id->clone();
             cols_id->concat("-cols");
             columns = new DistEffColArr(schema->types, cols_id, kvStore, key->node, true);
             delete cols_id;
             locked_ = true;
+            appending_ = false;
+            version = kvStore->get_size_t_latest(key->node, id->clone()->concat("-version"));
+            for (size_t col = 0; version > 0 && col < columns->size(); col += 1) {
+                columns->get(col)->at_version(version);
+            }
         }
 
         /**
@@ -89,8 +117,80 @@ class DistDataFrame : public Object {
             return columns->get(col)->as_string()->get(row);
         }
 
+        /** Sum, min, max, count and mean of an int column, computed on the
+         *  nodes that hold its chunks. The frame must be locked. */
+        IntAgg aggregate_int(size_t col) {
+            assert(locked_);
+            return columns->get(col)->as_int()->array->aggregate();
+        }
+
+        FloatAgg aggregate_float(size_t col) {
+            assert(locked_);
+            return columns->get(col)->as_float()->array->aggregate();
+        }
+
+        /** How many distinct values column col holds, and how often each
+         *  one, approximately (see ColumnSketch), from one pass on the
+         *  nodes that hold its chunks. The frame must be locked. */
+        ColumnSketch sketch(size_t col) {
+            assert(locked_);
+            DistColumn* dcol = columns->get(col);
+            char type = dcol->get_type();
+            if (type == 'I') {
+                return dcol->as_int()->array->sketch();
+            } else if (type == 'F') {
+                return dcol->as_float()->array->sketch();
+            } else if (type == 'B') {
+                return dcol->as_bool()->array->sketch();
+            }
+            return dcol->as_string()->array->sketch();
+        }
+
+        /** Sketches every column and keeps the sketches with the frame as
+         *  its statistics, for stats; best done once, right after lock. */
+        void analyze() {
+            assert(locked_);
+            for (size_t col = 0; col < columns->size(); col += 1) {
+                DistColumn* dcol = columns->get(col);
+                char type = dcol->get_type();
+                if (type == 'I') {
+                    dcol->as_int()->array->analyze();
+                } else if (type == 'F') {
+                    dcol->as_float()->array->analyze();
+                } else if (type == 'B') {
+                    dcol->as_bool()->array->analyze();
+                } else {
+                    dcol->as_string()->array->analyze();
+                }
+            }
+        }
+
+        /** The sketch of column col that analyze kept, read without a pass over the column. */
+        ColumnSketch stats(size_t col) {
+            DistColumn* dcol = columns->get(col);
+            char type = dcol->get_type();
+            if (type == 'I') {
+                return dcol->as_int()->array->stats();
+            } else if (type == 'F') {
+                return dcol->as_float()->array->stats();
+            } else if (type == 'B') {
+                return dcol->as_bool()->array->stats();
+            }
+            return dcol->as_string()->array->stats();
+        }
+
+        /** Keeps no Bloom filters for the string columns, only zones; see
+         *  DistEffArr::no_blooms. For before any row is added. */
+        void no_blooms() {
+            assert(!locked_ && !appending_);
+            for (size_t col = 0; col < columns->size(); col += 1) {
+                DistColumn* dcol = columns->get(col);
+                if (dcol->get_type() == 'S') dcol->as_string()->array->no_blooms();
+            }
+        }
+
         void add_column(DistColumn* col) {
-            assert(!locked_);
+            assert(!locked_ && !appending_);
             schema->add_column(col->get_type());
             columns->push_back(col);
         }
@@ -117,80 +217,792 @@ class DistDataFrame : public Object {
             locked_ = true;
             columns->lock();
             schema->lock();
+            kvStore->put(columns->metadata_node, id->clone()->concat("-version"), version);
+        }
+
+        /**
+         * Lets a locked frame take more rows, with add_row, until commit.
+         * Readers see none of them until then: a handle made before commit
+         * keeps the rows it had, and one made after sees them all. There
+         * may be one writer at a time, on any node.
+         */
+        void reopen() {
+            assert(locked_ && !appending_);
+            locked_ = false;
+            appending_ = true;
+            for (size_t col = 0; col < columns->size(); col += 1) {
+                columns->get(col)->reopen();
+            }
         }
 
-        void fill_rows(Row** rows, DistIntColumn* col, size_t chunkNum, size_t col_num) {
-            FixedIntArray* curr = col->array->get_chunk(chunkNum);
-            for(size_t i = 0; i < curr->used; i++) {
-                rows[i]->set(col_num, curr->get(i));
+        /**
+         * Publishes the rows added since reopen and locks the frame again.
+         * Each column records its new layout and zones under the next
+         * version; the frame's version, which readers go by, moves on last,
+         * so no reader sees some columns grown and others not. Indexes and
+         * the statistics of analyze do not cover the new rows.
+         */
+        void commit() {
+            assert(appending_);
+            version += 1;
+            for (size_t col = 0; col < columns->size(); col += 1) {
+                columns->get(col)->commit(version);
             }
+            kvStore->put(columns->metadata_node, id->clone()->concat("-version"), version);
+            appending_ = false;
+            locked_ = true;
         }
 
-        void fill_rows(Row** rows, DistFloatColumn* col, size_t chunkNum, size_t col_num) {
-            FixedFloatArray* curr = col->array->get_chunk(chunkNum);
-            for(size_t i = 0; i < curr->used; i++) {
-                rows[i]->set(col_num, curr->get(i));
+        /** The chunk chunkIdx of column col, fetched from its node if need be. */
+        Object* chunk_(size_t col, size_t chunkIdx) {
+            DistColumn* dcol = columns->get(col);
+            char type = dcol->get_type();
+            if (type == 'I') {
+                return dcol->as_int()->array->get_chunk(chunkIdx);
+            } else if (type == 'F') {
+                return dcol->as_float()->array->get_chunk(chunkIdx);
+            } else if (type == 'B') {
+                return dcol->as_bool()->array->get_chunk(chunkIdx);
             }
+            return dcol->as_string()->array->get_chunk(chunkIdx);
         }
 
-        void fill_rows(Row** rows, DistBoolColumn* col, size_t chunkNum, size_t col_num) {
-            FixedBoolArray* curr = col->array->get_chunk(chunkNum);
-            for(size_t i = 0; i < curr->used; i++) {
-                rows[i]->set(col_num, curr->get(i));
+        /** A batch shaped to this frame's columns. */
+        Batch* new_batch_() {
+            size_t c = columns->size();
+            auto* batch = new Batch(c);
+            for (size_t i = 0; i < c; i += 1) {
+                batch->types[i] = columns->get(i)->get_type();
             }
+            return batch;
+        }
 
+        /** Points batch at chunk chunkIdx of the given columns and hands it to the reader. */
+        void visit_chunk_(Reader* reader, Batch& batch, size_t chunkIdx, const std::vector<size_t>& cols) {
+            DistColumn* first = columns->get(0);
+            batch.rows = first->chunk_rows(chunkIdx);
+            if (batch.rows == 0) return; // never stored; see filter
+            batch.start = first->chunk_start(chunkIdx);
+            for (size_t col : cols) {
+                batch.cols[col] = chunk_(col, chunkIdx);
+            }
+            reader->visit_batch(batch);
+        }
+
+        size_t num_chunks_() {
+            assert(streaming_.empty());
+            return columns->size() == 0 ? 0 : columns->get(0)->num_chunks();
         }
 
-        void fill_rows(Row** rows, DistStringColumn* col, size_t chunkNum, size_t col_num) {
-            FixedStrArray* curr = col->array->get_chunk(chunkNum);
-            for(size_t i = 0; i < curr->numElements(); i++) {
-                rows[i]->set(col_num, curr->get(i));
+        std::vector<size_t> all_columns_() {
+            std::vector<size_t> cols;
+            for (size_t i = 0; i < columns->size(); i += 1) {
+                cols.push_back(i);
             }
+            return cols;
         }
 
         /**
-         * Read this distributed df with the given reader
+         * Hands the reader every inc-th chunk of rows starting at index, one
+         * Batch per chunk, with the chunks of the given columns.
          */
-        void mapHelp(Reader* reader, size_t inc, size_t index) {
-            size_t r = columns->get(0)->size();
-            if (r == 0) return;
-            size_t c = columns->size();
-            size_t chunkSize = columns->chunkSize;
-            size_t numChunks = ((r - 1) / chunkSize) + 1;
-            Row** rows = new Row*[std::min(r, chunkSize)];
-            for (size_t i = 0; i < std::min(r, chunkSize); i += 1) {
-                rows[i] = new Row(c);
-            }
-            while(index < numChunks) {
-                for(size_t i = 0; i < c; i++) {
-                    DistColumn* dcol = columns->get(i);
-                    if(dcol->get_type() == 'I') {
-                        fill_rows(rows, dcol->as_int(), index, i);
-                    } else if(dcol->get_type() == 'F') {
-                        fill_rows(rows, dcol->as_float(), index, i);
-                    } else if(dcol->get_type() == 'B') {
-                        fill_rows(rows, dcol->as_bool(), index, i);
-                    } else {
-                        fill_rows(rows, dcol->as_string(), index, i);
+        void mapHelp(Reader* reader, size_t inc, size_t index, const std::vector<size_t>& cols) {
+            size_t numChunks = num_chunks_();
+            if (numChunks == 0) return;
+            Batch* batch = new_batch_();
+            for (; index < numChunks; index += inc) {
+                visit_chunk_(reader, *batch, index, cols);
+            }
+            delete batch;
+        }
+
+        void map(Reader* reader) {
+            mapHelp(reader, 1, 0, all_columns_());
+        }
+
+        /** Reads, in order, only the chunks pred may accept rows of, going by
+         *  their zones (see Rower::may_accept); the others are not fetched.
+         *  The reader sees whole chunks, rows pred rejects included. */
+        void map_where(Reader* reader, Rower* pred) {
+            map_where_(reader, pred, all_columns_());
+        }
+
+        /** map_where reading only the given columns. */
+        void map_where_(Reader* reader, Rower* pred, const std::vector<size_t>& cols) {
+            size_t numChunks = num_chunks_();
+            if (numChunks == 0) return;
+            Batch* batch = new_batch_();
+            for (size_t chunkIdx = 0; chunkIdx < numChunks; chunkIdx += 1) {
+                if (may_hold_(pred, chunkIdx)) visit_chunk_(reader, *batch, chunkIdx, cols);
+            }
+            delete batch;
+        }
+
+        /** Whether chunk chunkIdx may hold rows r accepts, by what its column keeps about it. */
+        bool may_hold_(Rower* r, size_t chunkIdx) {
+            int col = r->zone_col();
+            return col < 0 || r->may_accept(columns->get(col), chunkIdx);
+        }
+
+        /**
+         * Whether string column col holds value. Only the chunks whose Bloom
+         * filter lets value through are fetched and searched.
+         */
+        bool contains(size_t col, const char* value) {
+            DistStringColumn* column = columns->get(col)->as_string();
+            size_t len = strlen(value);
+            for (size_t chunkIdx = 0; chunkIdx < num_chunks_(); chunkIdx += 1) {
+                if (column->chunk_rows(chunkIdx) == 0 || !column->may_hold(chunkIdx, value, len)) continue;
+                FixedStrArray* chunk = column->array->get_chunk(chunkIdx);
+                for (size_t i = 0; i < chunk->numElements(); i += 1) {
+                    String* s = chunk->get(i);
+                    if (s->size() == len && memcmp(s->c_str(), value, len) == 0) return true;
+                }
+            }
+            return false;
+        }
+
+        /** Reads only the given columns; the chunks of the others are
+         *  neither fetched nor handed to the reader. */
+        void map_cols(Reader* reader, const std::vector<size_t>& cols) {
+            mapHelp(reader, 1, 0, cols);
+        }
+
+        /** Reads the chunks this node holds, in parallel where the reader can be cloned. */
+        void local_map(Reader* reader) {
+            local_map_cols(reader, all_columns_(), std::thread::hardware_concurrency());
+        }
+
+        void local_map(Reader* reader, size_t threads) {
+            local_map_cols(reader, all_columns_(), threads);
+        }
+
+        /**
+         * Reads the given columns of the chunks this node holds on up to
+         * threads threads. Each extra thread gets a clone of the reader and
+         * takes the next unread chunk whenever it is done with one; the
+         * clones are joined into the reader, in order, once all chunks are
+         * read. A reader whose clone returns nullptr is run on this thread
+         * alone. On a handle that follows a frame being written (see
+         * KDStore::stream) each chunk is read as soon as it lands here,
+         * and this returns once the frame is locked and every chunk read;
+         * the handle then reads the whole frame.
+         */
+        void local_map_cols(Reader* reader, const std::vector<size_t>& cols, size_t threads) {
+            local_map_where_(reader, nullptr, cols, threads);
+        }
+
+        /** local_map_cols skipping, unread, the chunks pred rules out by
+         *  their zones, as map_where does; with no pred it reads them all. */
+        void local_map_where_(Reader* reader, Rower* pred, const std::vector<size_t>& cols, size_t threads) {
+            size_t first = kvStore->index;
+            size_t mine = SIZE_MAX;
+            if (streaming_.empty()) {
+                size_t numChunks = num_chunks_();
+                mine = first < numChunks ? (numChunks - first + 4) / 5 : 0;
+            }
+            if (threads > mine) threads = mine;
+            Reader** readers = new Reader*[threads > 1 ? threads : 1];
+            readers[0] = reader;
+            size_t n = 1;
+            for (; n < threads; n += 1) {
+                readers[n] = dynamic_cast<Reader*>(reader->clone());
+                if (readers[n] == nullptr) break;
+            }
+            std::atomic<size_t> next(0);
+            auto work = [&](Reader* r) {
+                Batch* batch = new_batch_();
+                for (size_t k = next++; k < mine; k = next++) {
+                    if (streaming_.empty()) {
+                        if (pred == nullptr || may_hold_(pred, first + 5 * k)) visit_chunk_(r, *batch, first + 5 * k, cols);
+                    } else if (!visit_landed_(r, *batch, first + 5 * k, cols)) {
+                        break;
                     }
                 }
-                for(size_t i = 0; i < std::min(r, chunkSize); i++) {
-                    reader->visit(*rows[i]);
+                delete batch;
+            };
+            std::vector<std::thread> pool;
+            for (size_t i = 1; i < n; i += 1) {
+                pool.emplace_back(work, readers[i]);
+            }
+            work(reader);
+            for (auto& t : pool) {
+                t.join();
+            }
+            for (size_t i = 1; i < n; i += 1) {
+                reader->join_delete(readers[i]);
+            }
+            delete[] readers;
+            if (!streaming_.empty()) settle_();
+        }
+
+        /**
+         * Waits for chunk chunkIdx of the given columns to be stored on
+         * this node and hands it to the reader, as visit_chunk_ does. While
+         * the frame is written there are no metadata or zones to go by: the
+         * rows are those of the chunk, and the chunks are dense. False if
+         * the frame was locked without the chunk, which then ends the stream.
+         */
+        bool visit_landed_(Reader* reader, Batch& batch, size_t chunkIdx, const std::vector<size_t>& cols) {
+            for (size_t col : cols) {
+                String* key = columns->get(col)->id->clone()->concat("-")->concat(chunkIdx);
+                bool landed = kvStore->wait_local(key->c_str(), streaming_.c_str());
+                delete key;
+                if (!landed) return false;
+            }
+            for (size_t col : cols) {
+                batch.cols[col] = chunk_(col, chunkIdx);
+            }
+            size_t col = cols[0];
+            char type = batch.types[col];
+            if (type == 'I') {
+                batch.rows = batch.int_col(col)->numElements();
+            } else if (type == 'F') {
+                batch.rows = batch.float_col(col)->numElements();
+            } else if (type == 'B') {
+                batch.rows = batch.bool_col(col)->numElements();
+            } else {
+                batch.rows = batch.str_col(col)->numElements();
+            }
+            batch.start = chunkIdx * columns->get(col)->chunk_size();
+            reader->visit_batch(batch);
+            return true;
+        }
+
+        /** Makes a handle that followed a frame being written one on the
+         *  whole frame, once it is locked. */
+        void settle_() {
+            Key key(streaming_.c_str(), columns->metadata_node);
+            kvStore->wait_finished(streaming_.c_str());
+            delete columns;
+            delete schema;
+            read_(&key);
+            streaming_.clear();
+        }
+
+        /**
+         * The rows r accepts, as a new frame under out. Every node calls
+         * this on the same locked frame with an equivalent rower, like the
+         * other per-node steps of an application. Each node tests the rows
+         * of the chunks it holds and packs the ones kept into chunks it
+         * also holds, so no row crosses the network; only the counts go to
+         * out's home node, which writes the metadata and announces out
+         * once every node is done. Chunks the zones rule out for r (see
+         * Rower::may_accept) are skipped unread. Returns this node's handle
+         * on out.
+         */
+        DistDataFrame* filter(Rower* r, Key& out) {
+            assert(locked_);
+            size_t index = kvStore->index;
+            size_t nodes = std::min((size_t) 5, kvStore->network->num_nodes());
+            Schema outSchema;
+            for (size_t i = 0; i < columns->size(); i += 1) {
+                outSchema.add_column(columns->get(i)->get_type());
+            }
+            auto* result = new DistDataFrame(outSchema, &out, kvStore);
+            std::vector<size_t> chunks;
+            std::vector<std::vector<size_t>> kept;
+            size_t total = 0;
+            Batch* batch = new_batch_();
+            std::vector<size_t> cols = all_columns_();
+            for (size_t chunkIdx = index; index < nodes && chunkIdx < num_chunks_(); chunkIdx += 5) {
+                DistColumn* first = columns->get(0);
+                batch->rows = first->chunk_rows(chunkIdx);
+                if (batch->rows == 0 || !may_hold_(r, chunkIdx)) continue;
+                batch->start = first->chunk_start(chunkIdx);
+                for (size_t col : cols) {
+                    batch->cols[col] = chunk_(col, chunkIdx);
                 }
-                index += inc;
+                chunks.push_back(chunkIdx);
+                kept.emplace_back();
+                for (size_t i = 0; i < batch->rows; i += 1) {
+                    if (r->accept(batch->row(i))) kept.back().push_back(i);
+                }
+                total += kept.back().size();
             }
-            for (size_t i = 0; i < std::min(r, chunkSize); i += 1) {
-                delete rows[i];
+            delete batch;
+            for (size_t i = 0; i < columns->size(); i += 1) {
+                DistColumn* from = columns->get(i);
+                DistColumn* to = result->columns->get(i);
+                char type = from->get_type();
+                if (type == 'I') {
+                    keep_rows_(from->as_int()->array, to->as_int()->array, chunks, kept);
+                } else if (type == 'F') {
+                    keep_rows_(from->as_float()->array, to->as_float()->array, chunks, kept);
+                } else if (type == 'B') {
+                    keep_rows_(from->as_bool()->array, to->as_bool()->array, chunks, kept);
+                } else {
+                    keep_rows_(from->as_string()->array, to->as_string()->array, chunks, kept);
+                }
             }
-            delete[] rows;
+            return publish_(result, total, out);
         }
 
-        void map(Reader* reader) {
-            mapHelp(reader, 1, 0);
+        /**
+         * Groups the rows by the values of the key columns and computes the
+         * aggregates of each group, as a new frame under out holding the key
+         * columns and then one column per aggregate. Every node calls this,
+         * as with filter. Each node aggregates the chunks it holds (on
+         * several threads, see local_map), hands every other node the
+         * partial groups whose hash falls to it, and finishes its own share,
+         * so the final merge runs on all nodes at once and only partial
+         * groups cross the network. Groups come out in no particular order.
+         */
+        DistDataFrame* group_by(const std::vector<size_t>& keys, const std::vector<Aggregate>& aggs, Key& out) {
+            GroupTable table(keys, aggs, types_());
+            return group_by_(table, &table, nullptr, table.columns(), out);
         }
 
-        void local_map(Reader* reader) {
-            mapHelp(reader, 5, kvStore->index);
+        /** Groups into table the rows feed hands it, reading the given
+         *  columns of this node's chunks but those pred rules out; see
+         *  group_by and local_map_where_. */
+        DistDataFrame* group_by_(GroupTable& table, Reader* feed, Rower* pred, const std::vector<size_t>& cols, Key& out) {
+            assert(locked_);
+            size_t index = kvStore->index;
+            size_t nodes = std::min((size_t) 5, kvStore->network->num_nodes());
+            if (index < nodes) {
+                local_map_where_(feed, pred, cols, std::thread::hardware_concurrency());
+                std::vector<std::string> parts;
+                table.split(index, nodes, parts);
+                std::string theirs = exchange_(parts, out, "-groups-");
+                table.merge(theirs.data(), theirs.size());
+            }
+            std::string outTypes = table.out_types();
+            Schema schema(outTypes.c_str());
+            auto* result = new DistDataFrame(schema, &out, kvStore);
+            ChunkPacker packer(result->columns, index);
+            Row row(outTypes.size());
+            for (auto& itr : table.groups) {
+                table.fill(itr.first, &table.states[itr.second], row);
+                packer.add(row);
+                for (size_t col = 0; col < table.keys.size(); col += 1) {
+                    if (outTypes[col] == 'S') delete row.get_string(col);
+                }
+            }
+            packer.flush();
+            return publish_(result, packer.total, out);
+        }
+
+        /**
+         * The rows moved so that rows with equal values in the key columns
+         * share a node, as a new frame under out: each node holds the rows
+         * whose key hashes to it, in the chunks stored on it. Every node
+         * calls this, as with filter. Rows stream straight from the node
+         * that reads them to the node they belong to, in batches (see
+         * Outbox), and are packed into chunks there as they arrive.
+         */
+        DistDataFrame* repartition(const std::vector<size_t>& keys, Key& out) {
+            assert(locked_);
+            size_t index = kvStore->index;
+            size_t nodes = std::min((size_t) 5, kvStore->network->num_nodes());
+            std::string types = types_();
+            Schema schema(types.c_str());
+            auto* result = new DistDataFrame(schema, &out, kvStore);
+            ChunkPacker packer(result->columns, index);
+            if (index < nodes) {
+                RowShuffle rows(keys, nodes);
+                Outbox outbox(kvStore, out, "-rows-", nodes);
+                rows.outbox = &outbox;
+                std::thread inbox([&]() {
+                    Row row(types.size());
+                    std::string key;
+                    std::string values;
+                    for (size_t from = 0; from < nodes; from += 1) {
+                        outbox.receive(from, [&](const std::string& bytes) {
+                            for (size_t pos = 0; pos < bytes.size();) {
+                                RowBytes::next(bytes, pos, key);
+                                RowBytes::next(bytes, pos, values);
+                                RowBytes::unpack(types, values, row, 0);
+                                packer.add(row);
+                                RowBytes::free(types, row, 0);
+                            }
+                        });
+                    }
+                });
+                local_map(&rows);
+                outbox.finish(rows.out);
+                inbox.join();
+            }
+            packer.flush();
+            return publish_(result, packer.total, out);
+        }
+
+        /** Up to this many rows, join copies the right frame to every node
+         *  rather than shuffling both frames. */
+        static const size_t BROADCAST_ROWS = 10000;
+
+        /**
+         * The inner equi-join of this frame with right, matching the values
+         * of leftKeys here with rightKeys there, as a new frame under out
+         * holding this frame's columns and then right's. Every node calls
+         * this, as with filter. A right frame of at most BROADCAST_ROWS rows
+         * is read whole by every node into a hash table, which the rows each
+         * node holds of this frame probe, so this frame never moves.
+         * Otherwise both frames are shuffled by the hash of their keys and
+         * each node joins the share that falls to it. Rows come out in no
+         * particular order.
+         */
+        DistDataFrame* join(DistDataFrame* right, const std::vector<size_t>& leftKeys,
+                            const std::vector<size_t>& rightKeys, Key& out) {
+            assert(locked_ && right->locked_);
+            assert(leftKeys.size() == rightKeys.size());
+            std::string leftTypes = types_();
+            std::string rightTypes = right->types_();
+            for (size_t k = 0; k < leftKeys.size(); k += 1) {
+                assert(leftTypes[leftKeys[k]] == rightTypes[rightKeys[k]]);
+            }
+            size_t index = kvStore->index;
+            size_t nodes = std::min((size_t) 5, kvStore->network->num_nodes());
+            JoinTable table(leftTypes, rightTypes);
+            std::string probe;
+            if (index < nodes) {
+                if (right->columns->get(0)->size() <= BROADCAST_ROWS) {
+                    RowShuffle all(rightKeys, 1);
+                    right->map(&all);
+                    table.build(all.out[0]);
+                    RowShuffle mine(leftKeys, 1);
+                    local_map(&mine);
+                    probe.swap(mine.out[0]);
+                } else {
+                    table.build(right->shuffle_(rightKeys, out, "-right-"));
+                    probe = shuffle_(leftKeys, out, "-left-");
+                }
+            }
+            Schema schema((leftTypes + rightTypes).c_str());
+            auto* result = new DistDataFrame(schema, &out, kvStore);
+            ChunkPacker packer(result->columns, index);
+            table.probe(probe, packer);
+            packer.flush();
+            return publish_(result, packer.total, out);
+        }
+
+        /** How many rows each node samples for sort to pick splitters by. */
+        static const size_t SORT_SAMPLES = 64;
+
+        /**
+         * The rows ordered by column col, as a new frame under out whose
+         * chunks, taken in order, hold the rows in order. Every node calls
+         * this, as with filter. It is a sample sort: each node sorts the
+         * rows it holds and sends every node a sample, so all of them pick
+         * the same splitters; each row then goes to the node of its range,
+         * which sorts what it gets. Knowing how many rows the nodes before
+         * it have, each node finally sends every row to the node that holds
+         * the chunk of the row's place in the order. Rows with equal values
+         * come out in no particular order.
+         */
+        DistDataFrame* sort(size_t col, bool descending, Key& out) {
+            assert(locked_);
+            size_t index = kvStore->index;
+            size_t nodes = std::min((size_t) 5, kvStore->network->num_nodes());
+            std::string types = types_();
+            Schema schema(types.c_str());
+            auto* result = new DistDataFrame(schema, &out, kvStore);
+            ChunkPacker packer(result->columns, index);
+            std::vector<std::pair<size_t, std::string>> placed; // this node's rows by place in the order
+            if (index < nodes) {
+                RowSorter sorter(col, types[col], descending);
+                local_map(&sorter);
+                sorter.sort();
+                std::vector<std::string> parts(nodes, sorter.samples(SORT_SAMPLES));
+                std::string samples = exchange_(parts, out, "-samples-");
+                sorter.split(sorter.splitters(samples, nodes), parts);
+                parts.resize(nodes);
+                sorter.merge(exchange_(parts, out, "-range-"));
+                sorter.sort();
+                size_t have[2] = {index, sorter.entries.size()};
+                parts.assign(nodes, std::string(reinterpret_cast<const char*>(have), sizeof(have)));
+                std::string counts = exchange_(parts, out, "-counts-");
+                size_t start = 0;
+                for (size_t pos = 0; pos < counts.size(); pos += sizeof(have)) {
+                    size_t theirs[2];
+                    memcpy(theirs, counts.data() + pos, sizeof(theirs));
+                    if (theirs[0] < index) start += theirs[1];
+                }
+                parts.assign(nodes, std::string());
+                for (size_t i = 0; i < sorter.entries.size(); i += 1) {
+                    size_t place = start + i;
+                    std::string& part = parts[(place / packer.chunkSize) % nodes];
+                    part.append(reinterpret_cast<const char*>(&place), sizeof(place));
+                    RowBytes::append(part, sorter.entries[i].values);
+                }
+                std::vector<SortEntry>().swap(sorter.entries);
+                std::string mine = exchange_(parts, out, "-place-");
+                for (size_t pos = 0; pos < mine.size();) {
+                    placed.emplace_back();
+                    memcpy(&placed.back().first, mine.data() + pos, sizeof(size_t));
+                    pos += sizeof(size_t);
+                    RowBytes::next(mine, pos, placed.back().second);
+                }
+                std::sort(placed.begin(), placed.end());
+            }
+            Row row(types.size());
+            for (auto& itr : placed) {
+                RowBytes::unpack(types, itr.second, row, 0);
+                packer.add(row);
+                RowBytes::free(types, row, 0);
+            }
+            packer.flush();
+            return publish_(result, packer.total, out);
+        }
+
+        /** The k rows with the greatest values in column col, as with
+         *  top_k below, over the frame as a whole. */
+        DistDataFrame* top_k(size_t col, size_t k, Key& out) {
+            return top_k(col, k, std::vector<size_t>(), out);
+        }
+
+        /**
+         * The k rows with the greatest values in the int, float or bool
+         * column col of each group of rows with equal values in the key
+         * columns, as a new frame under out with this frame's columns.
+         * Every node calls this, as with filter. Each node keeps the best k
+         * of each group among the rows it holds (see TopK) and sends only
+         * those to out's home node, which merges them and holds the whole
+         * result; so no more than k rows per group leave a node. Groups
+         * come out in ascending order of their key values, as sort orders
+         * them, each greatest first; rows with equal values in col in no
+         * particular order.
+         */
+        DistDataFrame* top_k(size_t col, size_t k, const std::vector<size_t>& keys, Key& out) {
+            assert(locked_);
+            size_t index = kvStore->index;
+            size_t nodes = std::min((size_t) 5, kvStore->network->num_nodes());
+            std::string types = types_();
+            Schema schema(types.c_str());
+            auto* result = new DistDataFrame(schema, &out, kvStore);
+            ChunkPacker packer(result->columns, index);
+            TopK top(col, types, k, keys);
+            if (index < nodes) local_map(&top);
+            std::string theirs = gather_(index < nodes ? top.pack() : std::string(), out, "-top-");
+            if (index == out.node) {
+                top.merge(theirs);
+                Row row(types.size());
+                for (std::string& values : top.rows()) {
+                    RowBytes::unpack(types, values, row, 0);
+                    packer.add(row);
+                    RowBytes::free(types, row, 0);
+                }
+            }
+            packer.flush();
+            return publish_(result, packer.total, out);
+        }
+
+        /**
+         * A hash index on column col, under out; see DistIndex. Every node
+         * calls this, as with filter. Each node hashes the values of the
+         * chunks it holds and hands every entry to the node its hash falls
+         * to, which sorts what it gets into its partition; out's home node
+         * announces the index once every partition is in place. Returns
+         * this node's handle on it, which reads this frame.
+         */
+        DistIndex* index(size_t col, Key& out) {
+            assert(locked_);
+            size_t index = kvStore->index;
+            size_t nodes = std::min((size_t) 5, kvStore->network->num_nodes());
+            String* part = out.key->clone()->concat("-index-");
+            if (index < nodes) {
+                std::vector<std::string> parts(nodes);
+                DistColumn* column = columns->get(col);
+                Batch* batch = new_batch_();
+                for (size_t chunkIdx = index; chunkIdx < num_chunks_(); chunkIdx += 5) {
+                    batch->rows = column->chunk_rows(chunkIdx);
+                    if (batch->rows == 0) continue;
+                    batch->cols[col] = chunk_(col, chunkIdx);
+                    DistIndex::add(*batch, col, chunkIdx, parts);
+                }
+                delete batch;
+                std::string mine = exchange_(parts, out, "-entries-");
+                kvStore->put(index, part->clone()->concat(index), DistIndex::partition(mine));
+                if (index != out.node) kvStore->put(out.node, part->clone()->concat("built-")->concat(index), true);
+            }
+            if (index == out.node) {
+                for (size_t node = 0; node < nodes; node += 1) {
+                    if (node == index) continue;
+                    String* built = part->clone()->concat("built-")->concat(node);
+                    delete kvStore->take_local(built->c_str());
+                    delete built;
+                }
+                kvStore->send_finished_update(out.key->c_str());
+            }
+            delete part;
+            kvStore->wait_finished(out.key->c_str());
+            return new DistIndex(columns->get(col), out, kvStore, nodes);
+        }
+
+        /** A plan over this frame's rows with no steps yet; see Plan. */
+        Plan plan() {
+            assert(locked_);
+            return Plan(this, types_());
+        }
+
+        /** The type of every column, in order. */
+        std::string types_() {
+            std::string types;
+            for (size_t i = 0; i < columns->size(); i += 1) {
+                types.push_back(columns->get(i)->get_type());
+            }
+            return types;
+        }
+
+        /** This node's share of the rows of every node, packed by RowShuffle
+         *  and partitioned by the hash of the key columns. */
+        std::string shuffle_(const std::vector<size_t>& keys, Key& out, const char* tag) {
+            size_t nodes = std::min((size_t) 5, kvStore->network->num_nodes());
+            RowShuffle rows(keys, nodes);
+            Outbox outbox(kvStore, out, tag, nodes);
+            rows.outbox = &outbox;
+            std::string mine;
+            std::thread inbox([&]() {
+                for (size_t from = 0; from < nodes; from += 1) {
+                    outbox.receive(from, [&](const std::string& bytes) { mine.append(bytes); });
+                }
+            });
+            local_map(&rows);
+            outbox.finish(rows.out);
+            inbox.join();
+            return mine;
+        }
+
+        /**
+         * Hands parts[node] to every other node, under out's key, tag and
+         * this node's index, and returns parts[index] followed by what every
+         * other node handed this one. Every node calls this with the same
+         * out and tag.
+         */
+        std::string exchange_(std::vector<std::string>& parts, Key& out, const char* tag) {
+            size_t index = kvStore->index;
+            size_t nodes = std::min((size_t) 5, kvStore->network->num_nodes());
+            String* part = out.key->clone()->concat(tag);
+            for (size_t node = 0; node < nodes; node += 1) {
+                if (node == index) continue;
+                auto* chunk = new FixedCharArray(parts[node].size());
+                memcpy(chunk->array, parts[node].data(), parts[node].size());
+                chunk->used = parts[node].size();
+                kvStore->put(node, part->clone()->concat(index), chunk);
+                std::string().swap(parts[node]);
+            }
+            std::string mine;
+            mine.swap(parts[index]);
+            for (size_t node = 0; node < nodes; node += 1) {
+                if (node == index) continue;
+                String* theirs = part->clone()->concat(node);
+                Transfer* transfer = kvStore->take_local(theirs->c_str());
+                mine.append(transfer->char_chunk()->array, transfer->char_chunk()->used);
+                delete transfer;
+                delete theirs;
+            }
+            delete part;
+            return mine;
+        }
+
+        /**
+         * Hands part to out's home node, under out's key, tag and this
+         * node's index. On the home node returns what every other node
+         * handed it; elsewhere, nothing. Every node calls this with the same
+         * out and tag.
+         */
+        std::string gather_(const std::string& part, Key& out, const char* tag) {
+            size_t index = kvStore->index;
+            size_t nodes = std::min((size_t) 5, kvStore->network->num_nodes());
+            String* key = out.key->clone()->concat(tag);
+            std::string all;
+            if (index != out.node && index < nodes) {
+                auto* chunk = new FixedCharArray(part.size());
+                memcpy(chunk->array, part.data(), part.size());
+                chunk->used = part.size();
+                kvStore->put(out.node, key->clone()->concat(index), chunk);
+            }
+            for (size_t node = 0; index == out.node && node < nodes; node += 1) {
+                if (node == index) continue;
+                String* theirs = key->clone()->concat(node);
+                Transfer* transfer = kvStore->take_local(theirs->c_str());
+                all.append(transfer->char_chunk()->array, transfer->char_chunk()->used);
+                delete transfer;
+                delete theirs;
+            }
+            delete key;
+            return all;
+        }
+
+        /**
+         * The last step of building a frame on every node at once, each
+         * node having stored total rows of result in its own chunks (see
+         * ChunkPacker): the counts, and the zones of the chunks, go to out's
+         * home node in one message per node, and the home node describes
+         * the layout, locks the frame and announces it. Takes result;
+         * returns this node's handle on out once it is announced.
+         */
+        DistDataFrame* publish_(DistDataFrame* result, size_t total, Key& out) {
+            size_t index = kvStore->index;
+            size_t nodes = std::min((size_t) 5, kvStore->network->num_nodes());
+            String* part = out.key->clone()->concat("-part-");
+            if (index < nodes) {
+                std::string bytes(reinterpret_cast<const char*>(&total), sizeof(total));
+                for (size_t i = 0; i < result->columns->size(); i += 1) {
+                    RowBytes::append(bytes, result->columns->get(i)->zone_bytes());
+                }
+                auto* chunk = new FixedCharArray(bytes.size());
+                memcpy(chunk->array, bytes.data(), bytes.size());
+                chunk->used = bytes.size();
+                kvStore->put(out.node, part->clone()->concat(index), chunk);
+            }
+            if (index == out.node) {
+                size_t chunkSize = result->columns->get(0)->chunk_size();
+                std::vector<size_t> rows;
+                std::string column;
+                for (size_t node = 0; node < nodes; node += 1) {
+                    String* theirs = part->clone()->concat(node);
+                    Transfer* transfer = kvStore->take_local(theirs->c_str());
+                    std::string bytes(transfer->char_chunk()->array, transfer->char_chunk()->used);
+                    delete transfer;
+                    delete theirs;
+                    size_t left;
+                    memcpy(&left, bytes.data(), sizeof(left));
+                    size_t pos = sizeof(left);
+                    for (size_t i = 0; i < result->columns->size(); i += 1) {
+                        RowBytes::next(bytes, pos, column);
+                        result->columns->get(i)->add_zones(column);
+                    }
+                    for (size_t chunkIdx = node; left > 0; chunkIdx += 5) {
+                        if (rows.size() <= chunkIdx) rows.resize(chunkIdx + 1, 0);
+                        rows[chunkIdx] = std::min(left, chunkSize);
+                        left -= rows[chunkIdx];
+                    }
+                }
+                for (size_t i = 0; i < result->columns->size(); i += 1) {
+                    result->columns->get(i)->set_chunk_rows(rows);
+                }
+                result->lock();
+                kvStore->send_finished_update(out.key->c_str());
+            }
+            delete part;
+            delete result;
+            kvStore->wait_finished(out.key->c_str());
+            return new DistDataFrame(&out, kvStore);
+        }
+
+        /** Packs the kept rows of this node's chunks of from into full chunks
+         *  of to, stored on this node as to's chunks index, index + 5, ... */
+        template <class T>
+        void keep_rows_(DistEffArr<T>* from, DistEffArr<T>* to, const std::vector<size_t>& chunks,
+                        const std::vector<std::vector<size_t>>& kept) {
+            typedef typename ArrayTraits<T>::Chunk Chunk;
+            Chunk* packed = nullptr;
+            size_t chunkIdx = kvStore->index;
+            for (size_t k = 0; k < chunks.size(); k += 1) {
+                if (kept[k].empty()) continue;
+                Chunk* chunk = from->get_chunk(chunks[k]);
+                for (size_t row : kept[k]) {
+                    if (packed == nullptr) packed = new Chunk(to->chunkSize);
+                    packed->pushBack(chunk->get(row));
+                    if (packed->numElements() == to->chunkSize) {
+                        to->store_chunk(chunkIdx, packed);
+                        chunkIdx += 5;
+                        packed = nullptr;
+                    }
+                }
+            }
+            if (packed != nullptr) to->store_chunk(chunkIdx, packed);
         }
 
         static DistDataFrame *fromArray(Key *key, KDStore *kdStore, size_t size, bool *vals);
@@ -215,13 +1027,42 @@ class KDStore : public Object {
             kvStore = new Distributable(index);
         }
 
+        /** A store running over the given transport, which it takes ownership of. */
+        KDStore(size_t idx, NetworkIfc* network) : Object() {
+            index = idx;
+            kvStore = new Distributable(index, network);
+        }
+
         ~KDStore() {
             delete kvStore;
         }
 
+        /** Has this node finished connecting to the rest of the cluster? */
+        bool ready() {
+            return kvStore->ready();
+        }
+
+        /** Blocks until this node is connected to the rest of the cluster. */
+        void wait_ready() {
+            kvStore->wait_ready();
+        }
+
         DistDataFrame *get(Key &key);
 
         DistDataFrame *waitAndGet(Key &key);
+
+        /**
+         * A handle on the frame under key while it is still being written,
+         * with the given schema, before it is locked. Its local_map, and
+         * the steps that read through it such as group_by, take each chunk
+         * as soon as it is stored on this node rather than once the whole
+         * frame is, so work overlaps the writing; storing a chunk wakes the
+         * readers waiting for it, and the frame's Finished message ends the
+         * stream. The frame must be written densely, row by row, as
+         * fromVisitor does. Other reads must wait until local_map returns,
+         * when the handle reads like one from waitAndGet.
+         */
+        DistDataFrame *stream(Key &key, const char* types);
 };
 
 /**
@@ -308,6 +1149,42 @@ DistDataFrame* DistDataFrame::fromArray(Key* key, KDStore* kdStore, size_t size,
     return ddf;
 }
 
+/****************************************************************************
+ * Plan::
+ * The ends of a plan, which need the whole of DistDataFrame. Each reads
+ * only the chunks a leading filter may accept rows of; see Pipeline.
+ */
+void Plan::run(Reader* reader) {
+    Pipeline pipeline(this, reader);
+    frame->map_where_(&pipeline, &pipeline, columns());
+}
+
+void Plan::local_run(Reader* reader) {
+    Pipeline pipeline(this, reader);
+    frame->local_map_where_(&pipeline, &pipeline, columns(), std::thread::hardware_concurrency());
+}
+
+DistDataFrame* Plan::group_by(const std::vector<size_t>& keys, const std::vector<Aggregate>& aggs, Key& out) {
+    GroupTable table(keys, aggs, types());
+    Pipeline pipeline(this, &table);
+    return frame->group_by_(table, &pipeline, &pipeline, columns(), out);
+}
+
+DistDataFrame* Plan::collect(Key& out) {
+    size_t index = frame->kvStore->index;
+    size_t nodes = std::min((size_t) 5, frame->kvStore->network->num_nodes());
+    Schema schema(types().c_str());
+    auto* result = new DistDataFrame(schema, &out, frame->kvStore);
+    ChunkPacker packer(result->columns, index);
+    if (index < nodes) {
+        PackRows rows(&packer);
+        Pipeline pipeline(this, &rows);
+        frame->local_map_where_(&pipeline, &pipeline, columns(), 1);
+    }
+    packer.flush();
+    return frame->publish_(result, packer.total, out);
+}
+
 /**
  * Get the DistDataframe associated with the key
  * @param key - the key for the DistDataframe
@@ -323,13 +1200,18 @@ DistDataFrame* KDStore::get(Key& key) {
  * @return - DistDatafram associated with the key
  */
 DistDataFrame* KDStore::waitAndGet(Key& key) {
-    std::unique_lock<std::mutex> df_lock(kvStore->complete_df_lock);
-    while (kvStore->completed_dfs.find(std::string(key.key->c_str())) == kvStore->completed_dfs.end())
-        kvStore->complete_df_cond.wait(df_lock);
-    df_lock.unlock();
+    kvStore->wait_finished(key.key->c_str());
     return new DistDataFrame(&key, kvStore);
 }
 
+DistDataFrame* KDStore::stream(Key& key, const char* types) {
+    Schema schema(types);
+    auto* df = new DistDataFrame(schema, &key, kvStore);
+    df->locked_ = true;
+    df->streaming_ = key.key->c_str();
+    return df;
+}
+
 /**
  * Create a DistDataFrame from the given writer
  */
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <climits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "packer.h"
+#include "rower.h"
+
+/*************************************************************************
+ * Aggregate::
+ * One output column of a group-by: a function over a column of each group.
+ * count takes no column; sum, min, max and mean take an int or float one.
+ */
+class Aggregate : public Object {
+    public:
+        enum Fn { COUNT, SUM, MIN, MAX, MEAN };
+
+        Fn fn;
+        size_t col;
+
+        Aggregate(Fn fn_var, size_t col_var) : Object() {
+            fn = fn_var;
+            col = col_var;
+        }
+
+        static Aggregate count() { return Aggregate(COUNT, 0); }
+        static Aggregate sum(size_t col) { return Aggregate(SUM, col); }
+        static Aggregate min(size_t col) { return Aggregate(MIN, col); }
+        static Aggregate max(size_t col) { return Aggregate(MAX, col); }
+        static Aggregate mean(size_t col) { return Aggregate(MEAN, col); }
+
+        /** The type of the output column over a column of the given type.
+         *  The schema has no 64 bit int: int sums and counts are kept in 64
+         *  bits and must fit in an int when they are output; see GroupTable::fill. */
+        char out_type(char in) {
+            if (fn == COUNT) return 'I';
+            if (fn == MEAN) return 'F';
+            assert(in == 'I' || in == 'F');
+            return in;
+        }
+};
+
+/**
+ * The running value of one aggregate of one group: ints are summed and
+ * compared in i, floats in f, and n counts the rows. Partial states from
+ * different nodes merge.
+ */
+struct AggState {
+    int64_t i = 0;
+    double f = 0;
+    int64_t n = 0;
+};
+
+/*************************************************************************
+ * GroupTable::
+ * A hash table from the values of the key columns of a frame, packed into
+ * a string, to the states of the aggregates of that group. As a Reader it
+ * adds the rows of each batch, and clones and joins so local_map can fill
+ * it on several threads. Its groups can be split by hash into parts that
+ * travel as bytes and merge into the table of another node.
+ */
+class GroupTable : public Reader {
+    public:
+        std::vector<size_t> keys;
+        std::vector<Aggregate> aggs;
+        std::string types;    // the type of every column of the frame
+        std::unordered_map<std::string, size_t> groups; // to where the group's states start
+        std::vector<AggState> states;                    // aggs.size() per group
+
+        GroupTable(const std::vector<size_t>& keys_var, const std::vector<Aggregate>& aggs_var, const std::string& types_var) {
+            keys = keys_var;
+            aggs = aggs_var;
+            types = types_var;
+        }
+
+        /** The columns a batch must carry for this table. */
+        std::vector<size_t> columns() {
+            std::vector<size_t> cols(keys);
+            for (Aggregate& agg : aggs) {
+                if (agg.fn != Aggregate::COUNT) cols.push_back(agg.col);
+            }
+            return cols;
+        }
+
+        void visit_batch(Batch& b) override {
+            std::string key;
+            for (size_t row = 0; row < b.rows; row += 1) {
+                key.clear();
+                for (size_t col : keys) {
+                    RowBytes::encode(b, col, row, key);
+                }
+                AggState* group = find_(key);
+                for (size_t a = 0; a < aggs.size(); a += 1) {
+                    AggState& st = group[a];
+                    Aggregate& agg = aggs[a];
+                    if (agg.fn != Aggregate::COUNT) {
+                        if (types[agg.col] == 'I') {
+                            add_(agg.fn, st, (int64_t) b.int_col(agg.col)->get(row));
+                        } else {
+                            add_(agg.fn, st, (double) b.float_col(agg.col)->get(row));
+                        }
+                    }
+                    st.n += 1;
+                }
+            }
+        }
+
+        Rower* clone() override {
+            return new GroupTable(keys, aggs, types);
+        }
+
+        void join(Rower* other) override {
+            GroupTable* o = dynamic_cast<GroupTable*>(other);
+            for (auto& itr : o->groups) {
+                merge_(itr.first, &o->states[itr.second]);
+            }
+        }
+
+        /**
+         * Splits the groups by the hash of their key into parts: keeps the
+         * ones that fall to part self, and writes each other part's into
+         * out[part] as bytes for merge.
+         */
+        void split(size_t self, size_t parts, std::vector<std::string>& out) {
+            std::hash<std::string> hasher;
+            std::unordered_map<std::string, size_t> mine;
+            std::vector<AggState> mineStates;
+            out.assign(parts, std::string());
+            for (auto& itr : groups) {
+                size_t part = hasher(itr.first) % parts;
+                const AggState* group = &states[itr.second];
+                if (part == self) {
+                    mine.emplace(itr.first, mineStates.size());
+                    mineStates.insert(mineStates.end(), group, group + aggs.size());
+                    continue;
+                }
+                size_t len = itr.first.size();
+                out[part].append(reinterpret_cast<const char*>(&len), sizeof(len));
+                out[part].append(itr.first);
+                out[part].append(reinterpret_cast<const char*>(group), aggs.size() * sizeof(AggState));
+            }
+            groups.swap(mine);
+            states.swap(mineStates);
+        }
+
+        /** Merges groups in the form split writes them. */
+        void merge(const char* bytes, size_t size) {
+            size_t pos = 0;
+            std::vector<AggState> from(aggs.size());
+            std::string key;
+            while (pos < size) {
+                size_t len;
+                memcpy(&len, bytes + pos, sizeof(len));
+                pos += sizeof(len);
+                key.assign(bytes + pos, len);
+                pos += len;
+                memcpy(from.data(), bytes + pos, aggs.size() * sizeof(AggState));
+                pos += aggs.size() * sizeof(AggState);
+                merge_(key, from.data());
+            }
+        }
+
+        /** The schema of the result: the key columns, then one per aggregate. */
+        std::string out_types() {
+            std::string out;
+            for (size_t col : keys) {
+                out.push_back(types[col]);
+            }
+            for (Aggregate& agg : aggs) {
+                out.push_back(agg.out_type(agg.fn == Aggregate::COUNT ? 'I' : types[agg.col]));
+            }
+            return out;
+        }
+
+        /** Fills row with a group's key values and final aggregates. The
+         *  row's strings are new; the caller deletes them. A count or int
+         *  sum too large for an int column is an error, not cut down. */
+        void fill(const std::string& key, const AggState* group, Row& row) {
+            size_t pos = 0;
+            size_t out = 0;
+            for (size_t col : keys) {
+                RowBytes::decode(types[col], key, pos, row, out++);
+            }
+            for (size_t a = 0; a < aggs.size(); a += 1) {
+                const AggState& st = group[a];
+                Aggregate& agg = aggs[a];
+                bool isInt = agg.fn == Aggregate::COUNT || types[agg.col] == 'I';
+                if (agg.fn == Aggregate::COUNT) {
+                    row.set(out++, as_int_(st.n));
+                } else if (agg.fn == Aggregate::MEAN) {
+                    row.set(out++, (float) ((isInt ? (double) st.i : st.f) / st.n));
+                } else if (isInt) {
+                    row.set(out++, as_int_(st.i));
+                } else {
+                    row.set(out++, (float) st.f);
+                }
+            }
+        }
+
+        static int as_int_(int64_t v) {
+            assert(v >= INT_MIN && v <= INT_MAX);
+            return (int) v;
+        }
+
+        static void add_(Aggregate::Fn fn, AggState& st, int64_t v) {
+            if (fn == Aggregate::SUM || fn == Aggregate::MEAN) {
+                st.i += v;
+            } else if (st.n == 0 || (fn == Aggregate::MIN ? v < st.i : v > st.i)) {
+                st.i = v;
+            }
+        }
+
+        static void add_(Aggregate::Fn fn, AggState& st, double v) {
+            if (fn == Aggregate::SUM || fn == Aggregate::MEAN) {
+                st.f += v;
+            } else if (st.n == 0 || (fn == Aggregate::MIN ? v < st.f : v > st.f)) {
+                st.f = v;
+            }
+        }
+
+        /** The states of the group under key, made empty if it is new. */
+        AggState* find_(const std::string& key) {
+            auto itr = groups.find(key);
+            if (itr != groups.end()) return &states[itr->second];
+            groups.emplace(key, states.size());
+            states.resize(states.size() + aggs.size());
+            return &states[states.size() - aggs.size()];
+        }
+
+        void merge_(const std::string& key, const AggState* from) {
+            AggState* group = find_(key);
+            for (size_t a = 0; a < aggs.size(); a += 1) {
+                AggState& st = group[a];
+                const AggState& o = from[a];
+                Aggregate::Fn fn = aggs[a].fn;
+                if (o.n == 0) continue;
+                if (fn == Aggregate::SUM || fn == Aggregate::MEAN) {
+                    st.i += o.i;
+                    st.f += o.f;
+                } else if (fn == Aggregate::MIN) {
+                    if (st.n == 0 || o.i < st.i) st.i = o.i;
+                    if (st.n == 0 || o.f < st.f) st.f = o.f;
+                } else if (fn == Aggregate::MAX) {
+                    if (st.n == 0 || o.i > st.i) st.i = o.i;
+                    if (st.n == 0 || o.f > st.f) st.f = o.f;
+                }
+                st.n += o.n;
+            }
+        }
+};
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "batch.h"
+#include "column.h"
+
+/** Where a row of a frame lies: its chunk, its place in the chunk, and its index in the frame. */
+struct RowRef {
+    size_t chunk;
+    size_t offset;
+    size_t row;
+};
+
+/** One row of an index partition: the hash of the row's value and where the row lies. */
+struct IndexEntry {
+    uint64_t hash;
+    uint32_t chunk;
+    uint32_t offset;
+
+    bool operator<(const IndexEntry& o) const {
+        if (hash != o.hash) return hash < o.hash;
+        return chunk != o.chunk ? chunk < o.chunk : offset < o.offset;
+    }
+};
+
+/*************************************************************************
+ * DistIndex::
+ * A hash index on one column of a locked frame, built by
+ * DistDataFrame::index. The hash of a value picks the node that holds its
+ * entries, and each node keeps its partition in its own store as entries
+ * sorted by hash. A lookup sends the hashes of the values to the nodes
+ * that own them, one task per node whatever the number of values, and
+ * then checks each row found against the column's chunk, which is fetched
+ * once and cached, so that hash collisions drop out. A handle reads the
+ * column of the frame it was built from, and must not outlive that frame.
+ */
+class DistIndex : public Object {
+    public:
+        static constexpr const char* TASK = "index-lookup";
+
+        DistColumn* column; // not owned
+        Distributable* kvStore;
+        String* id;         // each node's partition is under id-<node>
+        size_t nodes;
+
+        DistIndex(DistColumn* column_var, Key& key, Distributable* kvStore_var, size_t nodes_var) : Object() {
+            column = column_var;
+            kvStore = kvStore_var;
+            id = key.key->clone()->concat("-index");
+            nodes = nodes_var;
+        }
+
+        ~DistIndex() {
+            delete id;
+        }
+
+        /** The rows whose value in the column is value, in frame order. */
+        template <class V>
+        std::vector<RowRef> find(V value) {
+            return find_all(std::vector<V>(1, value))[0];
+        }
+
+        /** The rows of each value, as with find, in one round trip to the
+         *  nodes that own the values. V is int, float, bool or const char*. */
+        template <class V>
+        std::vector<std::vector<RowRef>> find_all(const std::vector<V>& values) {
+            std::vector<std::vector<RowRef>> found(values.size());
+            std::vector<std::string> asks(nodes);
+            std::vector<std::vector<size_t>> asked(nodes); // which values each node was asked about
+            for (size_t i = 0; i < values.size(); i += 1) {
+                uint64_t h = ValueHash::of(values[i]);
+                asks[h % nodes].append(reinterpret_cast<const char*>(&h), sizeof(h));
+                asked[h % nodes].push_back(i);
+            }
+            Transfer** replies = kvStore->run_with(TASK, id->c_str(), asks);
+            for (size_t node = 0; node < nodes; node += 1) {
+                if (replies[node] == nullptr) continue;
+                FixedCharArray* bytes = replies[node]->char_chunk();
+                size_t pos = 0;
+                for (size_t i : asked[node]) {
+                    uint32_t hits;
+                    memcpy(&hits, bytes->array + pos, sizeof(hits));
+                    pos += sizeof(hits);
+                    for (uint32_t hit = 0; hit < hits; hit += 1) {
+                        uint32_t at[2];
+                        memcpy(at, bytes->array + pos, sizeof(at));
+                        pos += sizeof(at);
+                        if (!holds_(at[0], at[1], values[i])) continue;
+                        found[i].push_back(RowRef{at[0], at[1], column->chunk_start(at[0]) + at[1]});
+                    }
+                }
+                delete replies[node];
+            }
+            delete[] replies;
+            return found;
+        }
+
+        /** Adds the entries of the rows of b to parts, by the node that owns them. */
+        static void add(Batch& b, size_t col, size_t chunkIdx, std::vector<std::string>& parts) {
+            for (size_t row = 0; row < b.rows; row += 1) {
+                IndexEntry e;
+                if (b.types[col] == 'I') {
+                    e.hash = ValueHash::of(b.int_col(col)->get(row));
+                } else if (b.types[col] == 'F') {
+                    e.hash = ValueHash::of(b.float_col(col)->get(row));
+                } else if (b.types[col] == 'B') {
+                    e.hash = ValueHash::of(b.bool_col(col)->get(row));
+                } else {
+                    e.hash = ValueHash::of(b.str_col(col)->get(row));
+                }
+                e.chunk = (uint32_t) chunkIdx;
+                e.offset = (uint32_t) row;
+                parts[e.hash % parts.size()].append(reinterpret_cast<const char*>(&e), sizeof(e));
+            }
+        }
+
+        /** Sorts the entries this node owns into its partition. */
+        static FixedCharArray* partition(const std::string& entries) {
+            std::vector<IndexEntry> sorted(entries.size() / sizeof(IndexEntry));
+            memcpy(sorted.data(), entries.data(), entries.size());
+            std::sort(sorted.begin(), sorted.end());
+            auto* bytes = new FixedCharArray(entries.size());
+            memcpy(bytes->array, sorted.data(), entries.size());
+            bytes->used = entries.size();
+            return bytes;
+        }
+
+        /** The lookup task: for each hash in task->data, the count and then
+         *  the chunk and offset of the entries of this node's partition of
+         *  the index under task->key that carry it. */
+        static Transfer* lookup_task_(Distributable* store, Task* task) {
+            std::string key = std::string(task->key->c_str()) + "-" + std::to_string(store->index);
+            std::string out;
+            std::lock_guard<std::mutex> lck(store->map_lock);
+            auto itr = store->kvStore.find(key);
+            assert(itr != store->kvStore.end());
+            FixedCharArray* part = itr->second->char_chunk();
+            const IndexEntry* first = reinterpret_cast<const IndexEntry*>(part->array);
+            const IndexEntry* last = first + part->used / sizeof(IndexEntry);
+            for (size_t pos = 0; pos < task->data.size(); pos += sizeof(uint64_t)) {
+                IndexEntry probe = {0, 0, 0};
+                memcpy(&probe.hash, task->data.data() + pos, sizeof(probe.hash));
+                const IndexEntry* from = std::lower_bound(first, last, probe);
+                const IndexEntry* to = from;
+                while (to != last && to->hash == probe.hash) to += 1;
+                uint32_t hits = (uint32_t) (to - from);
+                out.append(reinterpret_cast<const char*>(&hits), sizeof(hits));
+                for (; from != to; from += 1) {
+                    out.append(reinterpret_cast<const char*>(&from->chunk), sizeof(from->chunk));
+                    out.append(reinterpret_cast<const char*>(&from->offset), sizeof(from->offset));
+                }
+            }
+            auto* bytes = new FixedCharArray(out.size());
+            memcpy(bytes->array, out.data(), out.size());
+            bytes->used = out.size();
+            return new Transfer(bytes);
+        }
+
+        bool holds_(size_t chunkIdx, size_t offset, int v) {
+            return column->as_int()->array->get_chunk(chunkIdx)->get(offset) == v;
+        }
+
+        bool holds_(size_t chunkIdx, size_t offset, float v) {
+            return column->as_float()->array->get_chunk(chunkIdx)->get(offset) == v;
+        }
+
+        bool holds_(size_t chunkIdx, size_t offset, bool v) {
+            return column->as_bool()->array->get_chunk(chunkIdx)->get(offset) == v;
+        }
+
+        bool holds_(size_t chunkIdx, size_t offset, const char* v) {
+            return strcmp(column->as_string()->array->get_chunk(chunkIdx)->get(offset)->c_str(), v) == 0;
+        }
+};
+
+static const bool dist_index_tasks_registered_ = Distributable::register_task(DistIndex::TASK, DistIndex::lookup_task_);
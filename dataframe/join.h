@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include "packer.h"
+#include "shuffle.h"
+
+/*************************************************************************
+ * JoinTable::
+ * The build side of a hash join: the rows of the right frame by key. Rows
+ * of the left frame, packed by RowShuffle, probe it, and every pair that
+ * matches is written out as the left row's values then the right row's.
+ */
+class JoinTable : public Object {
+    public:
+        std::string leftTypes;
+        std::string rightTypes;
+        std::unordered_multimap<std::string, std::string> rows;   // packed right rows by packed key
+
+        JoinTable(const std::string& leftTypes_var, const std::string& rightTypes_var) : Object() {
+            leftTypes = leftTypes_var;
+            rightTypes = rightTypes_var;
+        }
+
+        /** Adds right rows as RowShuffle packs them. */
+        void build(const std::string& bytes) {
+            size_t pos = 0;
+            std::string key;
+            std::string values;
+            while (pos < bytes.size()) {
+                RowBytes::next(bytes, pos, key);
+                RowBytes::next(bytes, pos, values);
+                rows.emplace(key, values);
+            }
+        }
+
+        /** Adds the joined rows of the given left rows to packer; returns how many. */
+        size_t probe(const std::string& bytes, ChunkPacker& packer) {
+            size_t matched = 0;
+            size_t pos = 0;
+            std::string key;
+            std::string values;
+            Row row(leftTypes.size() + rightTypes.size());
+            while (pos < bytes.size()) {
+                RowBytes::next(bytes, pos, key);
+                RowBytes::next(bytes, pos, values);
+                auto range = rows.equal_range(key);
+                if (range.first == range.second) continue;
+                RowBytes::unpack(leftTypes, values, row, 0);
+                for (auto itr = range.first; itr != range.second; itr++) {
+                    RowBytes::unpack(rightTypes, itr->second, row, leftTypes.size());
+                    packer.add(row);
+                    RowBytes::free(rightTypes, row, leftTypes.size());
+                    matched += 1;
+                }
+                RowBytes::free(leftTypes, row, 0);
+            }
+            return matched;
+        }
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <string>
+#include "batch.h"
+#include "column.h"
+#include "row.h"
+
+/*************************************************************************
+ * ChunkPacker::
+ * Appends rows to a frame that every node builds at once out of rows it
+ * already holds. The rows go into full chunks stored on this node, as
+ * chunks node, node + 5, node + 10, ... of each column, so nothing crosses
+ * the network; DistDataFrame::publish_ then describes the layout.
+ */
+class ChunkPacker : public Object {
+    public:
+        DistEffColArr* columns; // external
+        size_t width;
+        char* types;            // owned
+        Object** packed;        // owned; the chunk each column is filling
+        size_t chunkIdx;        // where the chunks being filled will be stored
+        size_t chunkSize;
+        size_t used;            // rows in the chunks being filled
+        size_t total;           // rows added so far
+
+        ChunkPacker(DistEffColArr* columns_var, size_t node) : Object() {
+            columns = columns_var;
+            width = columns->size();
+            types = new char[width];
+            packed = new Object*[width];
+            for (size_t col = 0; col < width; col += 1) {
+                types[col] = columns->get(col)->get_type();
+                packed[col] = nullptr;
+            }
+            chunkIdx = node;
+            chunkSize = width == 0 ? 0 : columns->get(0)->chunk_size();
+            used = 0;
+            total = 0;
+        }
+
+        ~ChunkPacker() {
+            assert(used == 0); // flush before letting go
+            delete[] types;
+            delete[] packed;
+        }
+
+        void add(Row& row) {
+            if (used == 0) start_();
+            for (size_t col = 0; col < width; col += 1) {
+                if (types[col] == 'I') {
+                    static_cast<FixedIntArray*>(packed[col])->pushBack(row.get_int(col));
+                } else if (types[col] == 'F') {
+                    static_cast<FixedFloatArray*>(packed[col])->pushBack(row.get_float(col));
+                } else if (types[col] == 'B') {
+                    static_cast<FixedBoolArray*>(packed[col])->pushBack(row.get_bool(col));
+                } else {
+                    static_cast<FixedStrArray*>(packed[col])->pushBack(row.get_string(col));
+                }
+            }
+            used += 1;
+            total += 1;
+            if (used == chunkSize) flush();
+        }
+
+        /** Stores the chunks being filled, full or not. */
+        void flush() {
+            if (used == 0) return;
+            for (size_t col = 0; col < width; col += 1) {
+                DistColumn* column = columns->get(col);
+                if (types[col] == 'I') {
+                    column->as_int()->array->store_chunk(chunkIdx, static_cast<FixedIntArray*>(packed[col]));
+                } else if (types[col] == 'F') {
+                    column->as_float()->array->store_chunk(chunkIdx, static_cast<FixedFloatArray*>(packed[col]));
+                } else if (types[col] == 'B') {
+                    column->as_bool()->array->store_chunk(chunkIdx, static_cast<FixedBoolArray*>(packed[col]));
+                } else {
+                    column->as_string()->array->store_chunk(chunkIdx, static_cast<FixedStrArray*>(packed[col]));
+                }
+                packed[col] = nullptr;
+            }
+            chunkIdx += 5;
+            used = 0;
+        }
+
+        void start_() {
+            for (size_t col = 0; col < width; col += 1) {
+                if (types[col] == 'I') {
+                    packed[col] = new FixedIntArray(chunkSize);
+                } else if (types[col] == 'F') {
+                    packed[col] = new FixedFloatArray(chunkSize);
+                } else if (types[col] == 'B') {
+                    packed[col] = new FixedBoolArray(chunkSize);
+                } else {
+                    packed[col] = new FixedStrArray(chunkSize);
+                }
+            }
+        }
+};
+
+/*************************************************************************
+ * RowBytes::
+ * Packs the values of rows into bytes and back: ints and floats as their
+ * bytes, bools as one byte, strings as their length then their characters.
+ * Used for group keys and for rows that travel between nodes.
+ */
+class RowBytes {
+    public:
+        /** Appends the value at row of column col of b to out. */
+        static void encode(Batch& b, size_t col, size_t row, std::string& out) {
+            char type = b.types[col];
+            if (type == 'I') {
+                int v = b.int_col(col)->get(row);
+                out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+            } else if (type == 'F') {
+                float v = b.float_col(col)->get(row);
+                out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+            } else if (type == 'B') {
+                out.push_back(b.bool_col(col)->get(row) ? 1 : 0);
+            } else {
+                String* v = b.str_col(col)->get(row);
+                uint32_t len = (uint32_t) v->size();
+                out.append(reinterpret_cast<const char*>(&len), sizeof(len));
+                out.append(v->c_str(), len);
+            }
+        }
+
+        /** Reads the next value, of the given type, at pos in bytes into
+         *  column col of row and moves pos past it. Strings are new. */
+        static void decode(char type, const std::string& bytes, size_t& pos, Row& row, size_t col) {
+            if (type == 'I') {
+                int v;
+                memcpy(&v, bytes.data() + pos, sizeof(v));
+                pos += sizeof(v);
+                row.set(col, v);
+            } else if (type == 'F') {
+                float v;
+                memcpy(&v, bytes.data() + pos, sizeof(v));
+                pos += sizeof(v);
+                row.set(col, v);
+            } else if (type == 'B') {
+                row.set(col, bytes[pos] != 0);
+                pos += 1;
+            } else {
+                uint32_t len;
+                memcpy(&len, bytes.data() + pos, sizeof(len));
+                pos += sizeof(len);
+                row.set(col, new String(bytes.data() + pos, len));
+                pos += len;
+            }
+        }
+
+        /** Appends bytes to to behind their length. */
+        static void append(std::string& to, const std::string& bytes) {
+            uint32_t len = (uint32_t) bytes.size();
+            to.append(reinterpret_cast<const char*>(&len), sizeof(len));
+            to.append(bytes);
+        }
+
+        /** Reads the next bytes append wrote at pos in from into to. */
+        static void next(const std::string& from, size_t& pos, std::string& to) {
+            uint32_t len;
+            memcpy(&len, from.data() + pos, sizeof(len));
+            pos += sizeof(len);
+            to.assign(from.data() + pos, len);
+            pos += len;
+        }
+
+        /** Reads a whole row of values of the given types into row, from column first on. */
+        static void unpack(const std::string& types, const std::string& values, Row& row, size_t first) {
+            size_t pos = 0;
+            for (size_t col = 0; col < types.size(); col += 1) {
+                decode(types[col], values, pos, row, first + col);
+            }
+        }
+
+        /** Deletes the strings unpack put in row. */
+        static void free(const std::string& types, Row& row, size_t first) {
+            for (size_t col = 0; col < types.size(); col += 1) {
+                if (types[col] == 'S') delete row.get_string(first + col);
+            }
+        }
+};
@@ -0,0 +1,319 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "batch.h"
+#include "groupby.h"
+#include "packer.h"
+#include "rower.h"
+
+class DistDataFrame;
+
+/*************************************************************************
+ * Mapper::
+ * One step of a plan that computes a new row from each row: map fills out,
+ * whose columns are of the types types() names, from in. Strings it sets
+ * in out are new; the plan deletes them once the row is used. A mapper may
+ * run on several threads at once, so map must not change the mapper.
+ */
+class Mapper : public Object {
+    public:
+        virtual std::string types() {
+            assert(false);
+        }
+
+        virtual void map(Row& in, Row& out) {
+            assert(false);
+        }
+};
+
+/** One recorded step of a Plan. */
+struct Stage {
+    enum Kind { FILTER, PROJECT, MAP };
+
+    Kind kind;
+    Rower* pred = nullptr;     // FILTER: keeps the rows it accepts; external
+    std::vector<size_t> cols;  // PROJECT: the columns kept, in order
+    Mapper* mapper = nullptr;  // MAP: external
+    std::string types;         // the types of the rows the step hands on
+};
+
+/*************************************************************************
+ * Plan::
+ * Steps over the rows of a locked frame that are recorded rather than run:
+ * filters, projections and maps, each taking the rows the one before hands
+ * on. Nothing is read until one of the ends is called: run and local_run
+ * hand the rows to a reader, group_by aggregates them and collect stores
+ * them as a frame. The steps then run fused, chunk by chunk, on the node
+ * that holds the chunk (see Pipeline), and no frame is written between
+ * them; only group_by's shuffle and collect's result are. The rowers and
+ * mappers are external and must outlive the plan.
+ */
+class Plan : public Object {
+    public:
+        DistDataFrame* frame; // external
+        std::string sourceTypes;
+        std::vector<Stage> stages;
+
+        Plan(DistDataFrame* frame_var, const std::string& sourceTypes_var) : Object() {
+            frame = frame_var;
+            sourceTypes = sourceTypes_var;
+        }
+
+        /** Keeps the rows r accepts. */
+        Plan& filter(Rower* r) {
+            Stage stage;
+            stage.kind = Stage::FILTER;
+            stage.pred = r;
+            stage.types = types();
+            stages.push_back(stage);
+            return *this;
+        }
+
+        /** Keeps the given columns, in the given order. */
+        Plan& project(const std::vector<size_t>& cols) {
+            Stage stage;
+            stage.kind = Stage::PROJECT;
+            stage.cols = cols;
+            std::string in = types();
+            for (size_t col : cols) {
+                assert(col < in.size());
+                stage.types.push_back(in[col]);
+            }
+            stages.push_back(stage);
+            return *this;
+        }
+
+        /** Replaces every row with the one m computes from it. */
+        Plan& map(Mapper* m) {
+            Stage stage;
+            stage.kind = Stage::MAP;
+            stage.mapper = m;
+            stage.types = m->types();
+            stages.push_back(stage);
+            return *this;
+        }
+
+        /** The types of the rows the plan ends with. */
+        std::string types() {
+            return stages.empty() ? sourceTypes : stages.back().types;
+        }
+
+        /** The columns of the frame the steps read: those of a leading
+         *  projection, else all of them. */
+        std::vector<size_t> columns() {
+            if (!stages.empty() && stages[0].kind == Stage::PROJECT) return stages[0].cols;
+            std::vector<size_t> cols;
+            for (size_t col = 0; col < sourceTypes.size(); col += 1) {
+                cols.push_back(col);
+            }
+            return cols;
+        }
+
+        /** Hands the rows to reader, one batch per chunk of the frame, on this node. */
+        void run(Reader* reader);
+
+        /** Hands the rows of the chunks this node holds to reader, in
+         *  parallel where it can be cloned; see DistDataFrame::local_map. */
+        void local_run(Reader* reader);
+
+        /** Groups the rows as DistDataFrame::group_by does, which every
+         *  node calls. The key columns and aggregates refer to the columns
+         *  the plan ends with. */
+        DistDataFrame* group_by(const std::vector<size_t>& keys, const std::vector<Aggregate>& aggs, Key& out);
+
+        /** The rows as a new frame under out, each node storing those of
+         *  the chunks it holds, as DistDataFrame::filter does. Every node
+         *  calls this. */
+        DistDataFrame* collect(Key& out);
+};
+
+/*************************************************************************
+ * Pipeline::
+ * Runs the steps of a plan over each batch it is handed and hands what
+ * comes out to sink as one batch: the rows kept, of the types the plan
+ * ends with. A plan of projections alone just rewires the chunks; any
+ * other copies the rows kept into chunks of its own, strings by pointer.
+ * It clones and joins with its sink. A leading filter's zones and Bloom
+ * filters (see Rower::may_accept) rule out chunks before they are read.
+ */
+class Pipeline : public Reader {
+    public:
+        Plan* plan;         // external
+        Reader* sink;       // owned if this pipeline is a clone
+        bool ownsSink;
+        bool rewires;       // whether the plan is projections alone
+        std::vector<size_t> from;  // when rewiring, the column of the batch each output column is
+        std::vector<Row*> rows;    // owned; the row each step hands on, for projections and maps
+        Batch* out;         // owned
+        std::vector<String*> made; // strings maps made for the batch being run
+
+        Pipeline(Plan* plan_var, Reader* sink_var) : Reader() {
+            plan = plan_var;
+            sink = sink_var;
+            ownsSink = false;
+            rewires = true;
+            for (size_t col = 0; col < plan->sourceTypes.size(); col += 1) {
+                from.push_back(col);
+            }
+            for (Stage& stage : plan->stages) {
+                rewires = rewires && stage.kind == Stage::PROJECT;
+                rows.push_back(stage.kind == Stage::FILTER ? nullptr : new Row(stage.types.size()));
+                if (stage.kind != Stage::PROJECT) continue;
+                std::vector<size_t> next;
+                for (size_t col : stage.cols) {
+                    next.push_back(from[col]);
+                }
+                from.swap(next);
+            }
+            std::string types = plan->types();
+            out = new Batch(types.size());
+            for (size_t col = 0; col < types.size(); col += 1) {
+                out->types[col] = types[col];
+            }
+        }
+
+        ~Pipeline() {
+            for (Row* row : rows) {
+                delete row;
+            }
+            delete out;
+            if (ownsSink) delete sink;
+        }
+
+        void visit_batch(Batch& in) override {
+            if (rewires) {
+                out->rows = in.rows;
+                out->start = in.start;
+                for (size_t col = 0; col < out->width; col += 1) {
+                    out->cols[col] = in.cols[from[col]];
+                }
+                sink->visit_batch(*out);
+                return;
+            }
+            start_(in.rows);
+            for (size_t i = 0; i < in.rows; i += 1) {
+                Row* row = &in.row(i);
+                bool kept = true;
+                for (size_t s = 0; kept && s < plan->stages.size(); s += 1) {
+                    Stage& stage = plan->stages[s];
+                    if (stage.kind == Stage::FILTER) {
+                        kept = stage.pred->accept(*row);
+                        continue;
+                    } else if (stage.kind == Stage::PROJECT) {
+                        for (size_t col = 0; col < stage.cols.size(); col += 1) {
+                            copy_(*row, stage.cols[col], *rows[s], col, stage.types[col]);
+                        }
+                    } else {
+                        stage.mapper->map(*row, *rows[s]);
+                        for (size_t col = 0; col < stage.types.size(); col += 1) {
+                            if (stage.types[col] == 'S') made.push_back(rows[s]->get_string(col));
+                        }
+                    }
+                    row = rows[s];
+                }
+                if (kept) add_(*row);
+            }
+            out->start = in.start;
+            sink->visit_batch(*out);
+            end_();
+        }
+
+        Rower* clone() override {
+            Reader* copy = dynamic_cast<Reader*>(sink->clone());
+            if (copy == nullptr) return nullptr;
+            auto* pipeline = new Pipeline(plan, copy);
+            pipeline->ownsSink = true;
+            return pipeline;
+        }
+
+        void join(Rower* other) override {
+            Pipeline* o = dynamic_cast<Pipeline*>(other);
+            sink->join_delete(o->sink);
+            o->sink = nullptr;
+            o->ownsSink = false;
+        }
+
+        int zone_col() override {
+            if (plan->stages.empty() || plan->stages[0].kind != Stage::FILTER) return -1;
+            return plan->stages[0].pred->zone_col();
+        }
+
+        bool may_accept(DistColumn* column, size_t chunkIdx) override {
+            return plan->stages[0].pred->may_accept(column, chunkIdx);
+        }
+
+        static void copy_(Row& from, size_t fromCol, Row& to, size_t toCol, char type) {
+            if (type == 'I') {
+                to.set(toCol, from.get_int(fromCol));
+            } else if (type == 'F') {
+                to.set(toCol, from.get_float(fromCol));
+            } else if (type == 'B') {
+                to.set(toCol, from.get_bool(fromCol));
+            } else {
+                to.set(toCol, from.get_string(fromCol));
+            }
+        }
+
+        /** Fresh chunks of room rows for the batch handed on. */
+        void start_(size_t room) {
+            out->rows = 0;
+            for (size_t col = 0; col < out->width; col += 1) {
+                char type = out->types[col];
+                if (type == 'I') {
+                    out->cols[col] = new FixedIntArray(room);
+                } else if (type == 'F') {
+                    out->cols[col] = new FixedFloatArray(room);
+                } else if (type == 'B') {
+                    out->cols[col] = new FixedBoolArray(room);
+                } else {
+                    out->cols[col] = new FixedStrArray(room);
+                }
+            }
+        }
+
+        void add_(Row& row) {
+            for (size_t col = 0; col < out->width; col += 1) {
+                char type = out->types[col];
+                if (type == 'I') {
+                    out->int_col(col)->pushBack(row.get_int(col));
+                } else if (type == 'F') {
+                    out->float_col(col)->pushBack(row.get_float(col));
+                } else if (type == 'B') {
+                    out->bool_col(col)->pushBack(row.get_bool(col));
+                } else {
+                    out->str_col(col)->array->pushBack(row.get_string(col)); // borrowed, not cloned
+                }
+            }
+            out->rows += 1;
+        }
+
+        /** Lets go of the chunks of the batch handed on, and of the strings maps made. */
+        void end_() {
+            for (size_t col = 0; col < out->width; col += 1) {
+                if (out->types[col] == 'S') out->str_col(col)->array->used = 0; // the strings are borrowed
+                delete out->cols[col];
+                out->cols[col] = nullptr;
+            }
+            for (String* s : made) {
+                delete s;
+            }
+            made.clear();
+        }
+};
+
+/** Adds every row of the batches it is handed to a ChunkPacker. */
+class PackRows : public Reader {
+    public:
+        ChunkPacker* packer; // external
+
+        explicit PackRows(ChunkPacker* packer_var) : Reader() {
+            packer = packer_var;
+        }
+
+        void visit_batch(Batch& b) override {
+            for (size_t i = 0; i < b.rows; i += 1) {
+                packer->add(b.row(i));
+            }
+        }
+};
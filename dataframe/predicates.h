@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string.h>
+#include "column.h"
+#include "rower.h"
+
+/*************************************************************************
+ * InRange::
+ * Accepts the rows whose value in an int, float or bool column lies in
+ * [lo, hi]. Chunks whose zone lies outside the range are skipped unread.
+ */
+class InRange : public Rower {
+    public:
+        size_t col;
+        char type;
+        double lo;
+        double hi;
+
+        InRange(size_t col_var, char type_var, double lo_var, double hi_var) {
+            assert(type_var == 'I' || type_var == 'F' || type_var == 'B');
+            col = col_var;
+            type = type_var;
+            lo = lo_var;
+            hi = hi_var;
+        }
+
+        bool accept(Row& r) override {
+            double v = type == 'I' ? r.get_int(col) : type == 'F' ? r.get_float(col) : r.get_bool(col);
+            return lo <= v && v <= hi;
+        }
+
+        int zone_col() override {
+            return (int) col;
+        }
+
+        bool may_accept(DistColumn* column, size_t chunkIdx) override {
+            return column->zone(chunkIdx).may_overlap(lo, hi);
+        }
+};
+
+/*************************************************************************
+ * StringIs::
+ * Accepts the rows whose value in a string column is the given string.
+ * Chunks whose Bloom filter rules the string out are skipped unread.
+ */
+class StringIs : public Rower {
+    public:
+        size_t col;
+        String* value; // owned
+
+        StringIs(size_t col_var, const char* value_var) {
+            col = col_var;
+            value = new String(value_var);
+        }
+
+        ~StringIs() {
+            delete value;
+        }
+
+        bool accept(Row& r) override {
+            return r.get_string(col)->equals(value);
+        }
+
+        int zone_col() override {
+            return (int) col;
+        }
+
+        bool may_accept(DistColumn* column, size_t chunkIdx) override {
+            return column->may_hold(chunkIdx, value->c_str(), value->size());
+        }
+};
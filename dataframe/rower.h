@@ -1,5 +1,9 @@
 #pragma once
 
+#include "batch.h"
+
+class DistColumn;
+
 /*******************************************************************************
  *  Rower::
  *  An interface for iterating through each row of a data frame. The intent
@@ -14,7 +18,21 @@ class Rower : public Object {
             call. The return value is used in filters to indicate that a row
             should be kept. */
         virtual bool accept(Row &r) {
+            return true;
+        }
+
+        /** The column may_accept judges chunks by, or -1, the default, if
+            this rower cannot rule out chunks. */
+        virtual int zone_col() {
+            return -1;
+        }
 
+        /** Whether chunk chunkIdx may hold rows accept takes, judging by
+            what column, the one zone_col() names, keeps about its chunks:
+            zones and, for strings, Bloom filters. filter, map_where and the
+            ends of a Plan skip, unread, the chunks this rules out. */
+        virtual bool may_accept(DistColumn* column, size_t chunkIdx) {
+            return true;
         }
 
         /** Once traversal of the data frame is complete the rowers that were
@@ -30,8 +48,10 @@ class Rower : public Object {
 
         }
 
+        /** A fresh rower to run over part of the data on another thread;
+            nullptr, the default, if this rower cannot be split. */
         virtual Rower* clone() {
-
+            return nullptr;
         }
 };
 
@@ -55,6 +75,15 @@ public:
         assert(false);
     }
 
+    /** Called by map once per chunk of rows. Readers that work a column at a
+        time override this; by default each row is visited in turn, so
+        row-at-a-time Readers work unchanged. */
+    virtual void visit_batch(Batch& b) {
+        for (size_t i = 0; i < b.rows; i += 1) {
+            visit(b.row(i));
+        }
+    }
+
     virtual bool done() {
         assert(false);
     }
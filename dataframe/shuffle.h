@@ -0,0 +1,140 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../network/network.h"
+#include "packer.h"
+#include "rower.h"
+
+/*************************************************************************
+ * Outbox::
+ * Bytes on their way from every node to every node in pieces: a stream
+ * per pair of nodes, each piece put on the receiving node under the key
+ * <out><tag><from>-<seq> and taken from there in order. The first byte of
+ * a piece tells whether the sender has more. Every node makes one with
+ * the same out and tag, sends to every node (itself included) and ends
+ * with finish, and receives from every node.
+ */
+class Outbox : public Object {
+    public:
+        static const size_t BATCH = 1 << 16;   // the bytes a sender gathers before a piece goes
+
+        Distributable* kvStore;   // external
+        String* prefix;           // owned
+        std::vector<size_t> sent; // the pieces sent to each node so far
+        std::mutex lock;
+
+        Outbox(Distributable* kvStore_var, Key& out, const char* tag, size_t nodes) : Object() {
+            kvStore = kvStore_var;
+            prefix = out.key->clone()->concat(tag);
+            sent.assign(nodes, 0);
+        }
+
+        ~Outbox() {
+            delete prefix;
+        }
+
+        /** Sends bytes to node as its next piece; last says none follow.
+         *  Safe to call from several threads. */
+        void send(size_t node, const std::string& bytes, bool last) {
+            size_t seq;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                seq = sent[node]++;
+            }
+            auto* chunk = new FixedCharArray(bytes.size() + 1);
+            chunk->array[0] = last ? 1 : 0;
+            memcpy(chunk->array + 1, bytes.data(), bytes.size());
+            chunk->used = bytes.size() + 1;
+            kvStore->put(node, key_(kvStore->index, seq), chunk);
+        }
+
+        /** Sends every node the rest of its part as its last piece. */
+        void finish(std::vector<std::string>& parts) {
+            for (size_t node = 0; node < parts.size(); node += 1) {
+                send(node, parts[node], true);
+                std::string().swap(parts[node]);
+            }
+        }
+
+        /** Hands fn each piece node from sends this one, in order, up to its last. */
+        void receive(size_t from, const std::function<void(const std::string&)>& fn) {
+            std::string bytes;
+            for (size_t seq = 0;; seq += 1) {
+                String* key = key_(from, seq);
+                Transfer* transfer = kvStore->take_local(key->c_str());
+                delete key;
+                FixedCharArray* chunk = transfer->char_chunk();
+                bool last = chunk->array[0] != 0;
+                bytes.assign(chunk->array + 1, chunk->used - 1);
+                delete transfer;
+                fn(bytes);
+                if (last) return;
+            }
+        }
+
+        String* key_(size_t from, size_t seq) {
+            return prefix->clone()->concat(from)->concat("-")->concat(seq);
+        }
+};
+
+/*************************************************************************
+ * RowShuffle::
+ * Packs the rows of a frame into parts by the hash of their key columns,
+ * ready to travel to the node that joins them. A row is its packed key,
+ * then the packed values of all of its columns (see RowBytes), each behind
+ * its length. With one part it just packs the rows it is handed. Given an
+ * Outbox, it sends each part on as soon as a batch of it has built up.
+ */
+class RowShuffle : public Reader {
+    public:
+        std::vector<size_t> keys;
+        size_t parts;
+        std::vector<std::string> out;   // one per part
+        Outbox* outbox = nullptr;       // external
+
+        RowShuffle(const std::vector<size_t>& keys_var, size_t parts_var) {
+            keys = keys_var;
+            parts = parts_var;
+            out.resize(parts);
+        }
+
+        void visit_batch(Batch& b) override {
+            std::hash<std::string> hasher;
+            std::string key;
+            std::string values;
+            for (size_t row = 0; row < b.rows; row += 1) {
+                key.clear();
+                values.clear();
+                for (size_t col : keys) {
+                    RowBytes::encode(b, col, row, key);
+                }
+                for (size_t col = 0; col < b.width; col += 1) {
+                    RowBytes::encode(b, col, row, values);
+                }
+                size_t to = parts == 1 ? 0 : hasher(key) % parts;
+                std::string& part = out[to];
+                RowBytes::append(part, key);
+                RowBytes::append(part, values);
+                if (outbox != nullptr && part.size() >= Outbox::BATCH) {
+                    outbox->send(to, part, false);
+                    part.clear();
+                }
+            }
+        }
+
+        Rower* clone() override {
+            auto* copy = new RowShuffle(keys, parts);
+            copy->outbox = outbox;
+            return copy;
+        }
+
+        void join(Rower* other) override {
+            RowShuffle* o = dynamic_cast<RowShuffle*>(other);
+            for (size_t part = 0; part < parts; part += 1) {
+                out[part].append(o->out[part]);
+            }
+        }
+};
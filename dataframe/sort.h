@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "packer.h"
+#include "rower.h"
+
+/** A row on its way through a sort: the value it is sorted by and the row packed by RowBytes. */
+struct SortEntry {
+    double num = 0;       // the value of an int, float or bool column
+    std::string str;      // the value of a string column
+    std::string values;
+};
+
+/*************************************************************************
+ * RowSorter::
+ * The rows of a frame as SortEntries, ordered by one column. As a Reader
+ * it collects the rows of each batch, and clones and joins so local_map
+ * can fill it on several threads. It samples its rows so that nodes can
+ * agree on splitters, and splits its rows into the ranges those bound.
+ */
+class RowSorter : public Reader {
+    public:
+        size_t col;
+        char type;
+        bool descending;
+        std::vector<SortEntry> entries;
+
+        RowSorter(size_t col_var, char type_var, bool descending_var) {
+            col = col_var;
+            type = type_var;
+            descending = descending_var;
+        }
+
+        void visit_batch(Batch& b) override {
+            for (size_t row = 0; row < b.rows; row += 1) {
+                entries.emplace_back();
+                SortEntry& e = entries.back();
+                if (type == 'I') {
+                    e.num = b.int_col(col)->get(row);
+                } else if (type == 'F') {
+                    e.num = b.float_col(col)->get(row);
+                } else if (type == 'B') {
+                    e.num = b.bool_col(col)->get(row) ? 1 : 0;
+                } else {
+                    String* v = b.str_col(col)->get(row);
+                    e.str.assign(v->c_str(), v->size());
+                }
+                for (size_t c = 0; c < b.width; c += 1) {
+                    RowBytes::encode(b, c, row, e.values);
+                }
+            }
+        }
+
+        Rower* clone() override {
+            return new RowSorter(col, type, descending);
+        }
+
+        void join(Rower* other) override {
+            RowSorter* o = dynamic_cast<RowSorter*>(other);
+            entries.insert(entries.end(), std::make_move_iterator(o->entries.begin()),
+                           std::make_move_iterator(o->entries.end()));
+        }
+
+        /** Whether a sorts before b. */
+        bool less(const SortEntry& a, const SortEntry& b) const {
+            return descending ? before(type, b, a) : before(type, a, b);
+        }
+
+        /** Whether a comes before b in the ascending order of a column of the given type. */
+        static bool before(char type, const SortEntry& a, const SortEntry& b) {
+            return type == 'S' ? a.str < b.str : a.num < b.num;
+        }
+
+        void sort() {
+            std::sort(entries.begin(), entries.end(),
+                      [this](const SortEntry& a, const SortEntry& b) { return less(a, b); });
+        }
+
+        /** The values of up to count evenly spaced entries, packed; sort first. */
+        std::string samples(size_t count) {
+            std::string out;
+            if (entries.empty()) return out;
+            count = std::min(count, entries.size());
+            for (size_t i = 0; i < count; i += 1) {
+                append_key_(out, entries[i * entries.size() / count]);
+            }
+            return out;
+        }
+
+        /** The parts - 1 entries that split the given samples, of every node, into parts even ranges. */
+        std::vector<SortEntry> splitters(const std::string& samples, size_t parts) {
+            std::vector<SortEntry> all;
+            size_t pos = 0;
+            while (pos < samples.size()) {
+                all.emplace_back();
+                next_key_(samples, pos, all.back());
+            }
+            std::sort(all.begin(), all.end(),
+                      [this](const SortEntry& a, const SortEntry& b) { return less(a, b); });
+            std::vector<SortEntry> out;
+            for (size_t part = 1; part < parts && !all.empty(); part += 1) {
+                out.push_back(all[part * all.size() / parts]);
+            }
+            return out;
+        }
+
+        /** Packs every entry into out[r], r being the range of the splitters
+         *  it falls in, in order; the entries are gone after. Sort first. */
+        void split(const std::vector<SortEntry>& splitters, std::vector<std::string>& out) {
+            out.assign(splitters.size() + 1, std::string());
+            size_t part = 0;
+            for (SortEntry& e : entries) {
+                while (part < splitters.size() && !less(e, splitters[part])) part += 1;
+                append_key_(out[part], e);
+                RowBytes::append(out[part], e.values);
+            }
+            std::vector<SortEntry>().swap(entries);
+        }
+
+        /** Adds entries in the form split writes them. */
+        void merge(const std::string& bytes) {
+            size_t pos = 0;
+            while (pos < bytes.size()) {
+                entries.emplace_back();
+                next_key_(bytes, pos, entries.back());
+                RowBytes::next(bytes, pos, entries.back().values);
+            }
+        }
+
+        void append_key_(std::string& out, const SortEntry& e) {
+            if (type == 'S') {
+                RowBytes::append(out, e.str);
+            } else {
+                out.append(reinterpret_cast<const char*>(&e.num), sizeof(e.num));
+            }
+        }
+
+        void next_key_(const std::string& from, size_t& pos, SortEntry& e) {
+            if (type == 'S') {
+                RowBytes::next(from, pos, e.str);
+            } else {
+                memcpy(&e.num, from.data() + pos, sizeof(e.num));
+                pos += sizeof(e.num);
+            }
+        }
+};
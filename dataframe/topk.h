@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "packer.h"
+#include "rower.h"
+#include "sort.h"
+
+/** A row held by a TopK: the value it is ranked by and the row packed by RowBytes. */
+struct TopEntry {
+    double num;
+    std::string values;
+
+    /** Orders a heap so that its front is the least entry. */
+    bool operator<(const TopEntry& o) const {
+        return num > o.num;
+    }
+};
+
+/*************************************************************************
+ * TopK::
+ * The k rows with the greatest values in an int, float or bool column, of
+ * each group of rows with equal values in the key columns; with no keys,
+ * of the whole frame. Each group keeps a heap of at most k rows, so a row
+ * that cannot make it is dropped without being packed. As a Reader it
+ * clones and joins so local_map can fill it on several threads, and its
+ * candidates travel as bytes to merge into the TopK of another node.
+ */
+class TopK : public Reader {
+    public:
+        size_t col;
+        std::string types; // of the frame's columns
+        char type;
+        size_t k;
+        std::vector<size_t> keys;
+        std::unordered_map<std::string, std::vector<TopEntry>> heaps; // by packed key values
+
+        TopK(size_t col_var, const std::string& types_var, size_t k_var, const std::vector<size_t>& keys_var) {
+            char type_var = types_var[col_var];
+            assert(type_var == 'I' || type_var == 'F' || type_var == 'B');
+            assert(k_var > 0);
+            col = col_var;
+            types = types_var;
+            type = type_var;
+            k = k_var;
+            keys = keys_var;
+        }
+
+        void visit_batch(Batch& b) override {
+            std::string key;
+            for (size_t row = 0; row < b.rows; row += 1) {
+                double num;
+                if (type == 'I') {
+                    num = b.int_col(col)->get(row);
+                } else if (type == 'F') {
+                    num = b.float_col(col)->get(row);
+                } else {
+                    num = b.bool_col(col)->get(row) ? 1 : 0;
+                }
+                key.clear();
+                for (size_t c : keys) {
+                    RowBytes::encode(b, c, row, key);
+                }
+                std::vector<TopEntry>& heap = heaps[key];
+                if (!admits_(heap, num)) continue;
+                TopEntry e;
+                e.num = num;
+                for (size_t c = 0; c < b.width; c += 1) {
+                    RowBytes::encode(b, c, row, e.values);
+                }
+                offer_(heap, e);
+            }
+        }
+
+        Rower* clone() override {
+            return new TopK(col, types, k, keys);
+        }
+
+        void join(Rower* other) override {
+            TopK* o = dynamic_cast<TopK*>(other);
+            for (auto& itr : o->heaps) {
+                std::vector<TopEntry>& heap = heaps[itr.first];
+                for (TopEntry& e : itr.second) {
+                    if (admits_(heap, e.num)) offer_(heap, e);
+                }
+            }
+        }
+
+        /** Every candidate, as bytes for merge. */
+        std::string pack() {
+            std::string out;
+            for (auto& itr : heaps) {
+                for (TopEntry& e : itr.second) {
+                    RowBytes::append(out, itr.first);
+                    out.append(reinterpret_cast<const char*>(&e.num), sizeof(e.num));
+                    RowBytes::append(out, e.values);
+                }
+            }
+            return out;
+        }
+
+        /** Adds candidates in the form pack writes them. */
+        void merge(const std::string& bytes) {
+            size_t pos = 0;
+            std::string key;
+            TopEntry e;
+            while (pos < bytes.size()) {
+                RowBytes::next(bytes, pos, key);
+                memcpy(&e.num, bytes.data() + pos, sizeof(e.num));
+                pos += sizeof(e.num);
+                RowBytes::next(bytes, pos, e.values);
+                std::vector<TopEntry>& heap = heaps[key];
+                if (admits_(heap, e.num)) offer_(heap, e);
+            }
+        }
+
+        /** The rows kept, group by group in ascending order of their key
+         *  values, compared column by column as RowSorter compares them,
+         *  greatest first within a group; the heaps are gone after. */
+        std::vector<std::string> rows() {
+            typedef std::pair<std::vector<SortEntry>, std::vector<TopEntry>*> Group;
+            std::vector<Group> groups;
+            for (auto& itr : heaps) {
+                groups.emplace_back(key_values_(itr.first), &itr.second);
+            }
+            std::sort(groups.begin(), groups.end(),
+                      [this](const Group& a, const Group& b) { return key_less_(a.first, b.first); });
+            std::vector<std::string> out;
+            for (Group& group : groups) {
+                std::sort_heap(group.second->begin(), group.second->end());
+                for (TopEntry& e : *group.second) {
+                    out.push_back(std::move(e.values));
+                }
+            }
+            heaps.clear();
+            return out;
+        }
+
+        /** The values in a key packed by RowBytes, one per key column. */
+        std::vector<SortEntry> key_values_(const std::string& key) {
+            std::vector<SortEntry> values(keys.size());
+            size_t pos = 0;
+            for (size_t i = 0; i < keys.size(); i += 1) {
+                char t = types[keys[i]];
+                if (t == 'I') {
+                    int v;
+                    memcpy(&v, key.data() + pos, sizeof(v));
+                    pos += sizeof(v);
+                    values[i].num = v;
+                } else if (t == 'F') {
+                    float v;
+                    memcpy(&v, key.data() + pos, sizeof(v));
+                    pos += sizeof(v);
+                    values[i].num = v;
+                } else if (t == 'B') {
+                    values[i].num = key[pos] != 0 ? 1 : 0;
+                    pos += 1;
+                } else {
+                    uint32_t len;
+                    memcpy(&len, key.data() + pos, sizeof(len));
+                    pos += sizeof(len);
+                    values[i].str.assign(key.data() + pos, len);
+                    pos += len;
+                }
+            }
+            return values;
+        }
+
+        /** Whether key values a come before b, the first key column first. */
+        bool key_less_(const std::vector<SortEntry>& a, const std::vector<SortEntry>& b) {
+            for (size_t i = 0; i < keys.size(); i += 1) {
+                char t = types[keys[i]];
+                if (RowSorter::before(t, a[i], b[i])) return true;
+                if (RowSorter::before(t, b[i], a[i])) return false;
+            }
+            return false;
+        }
+
+        /** Whether a row valued num gets into a group's heap. */
+        bool admits_(const std::vector<TopEntry>& heap, double num) {
+            return heap.size() < k || num > heap.front().num;
+        }
+
+        void offer_(std::vector<TopEntry>& heap, TopEntry& e) {
+            if (heap.size() == k) {
+                std::pop_heap(heap.begin(), heap.end());
+                heap.pop_back();
+            }
+            heap.push_back(std::move(e));
+            std::push_heap(heap.begin(), heap.end());
+        }
+};
@@ -1,9 +1,11 @@
 #pragma once
+#include <string>
 #include "../util/object.h"
 #include "msgKind.h"
 #include "../array/array.h"
+#include "../util/pool.h"
 
-class Message : public Object {
+class Message : public Object, public Pooled {
     public:
         MsgKind kind_;
         size_t sender_; // the index of the sender node
@@ -53,11 +55,41 @@ class Finished : public Message {
             key_ = new String(key);
         }
 
+        Finished* clone() override {
+            return new Finished(sender_, target_, id_, key_->c_str());
+        }
+
         ~Finished() {
             delete key_;
         }
 };
 
+/**
+ * Asks a node to run the task registered under name (see
+ * Distributable::register_task) over its local part of the data under key.
+ * The reply is a Send carrying the task's result under the same key.
+ */
+class Task : public Message {
+    public:
+        String* name;
+        String* key;
+        size_t arg;
+        std::string data; // input that is more than a number, as bytes; often empty
+
+        Task(const char* name_, const char* key_, size_t arg_) {
+            name = new String(name_);
+            key = new String(key_);
+            arg = arg_;
+            kind_ = MsgKind::Task;
+            id_ = 0;
+        }
+
+        ~Task() {
+            delete name;
+            delete key;
+        }
+};
+
 
 
 class Register : public Message {
@@ -136,9 +168,17 @@ union Data {
     FixedBoolArray* fb;
     FixedStrArray* fs;
     FixedCharArray* fc;
+
+    static void* operator new(size_t size) {
+        return Pool::alloc(size);
+    }
+
+    static void operator delete(void* p, size_t size) {
+        Pool::free(p, size);
+    }
 };
 
-class Transfer : public Object {
+class Transfer : public Object, public Pooled {
     public:
         Data* data;
         char type;
@@ -185,6 +225,24 @@ class Transfer : public Object {
             data->b = var;
         }
 
+        /** Deep copy of this transfer, including the chunk it carries. */
+        Transfer* clone() {
+            if (type == 'I') {
+                return new Transfer(data->fi->clone());
+            } else if (type == 'F') {
+                return new Transfer(data->ff->clone());
+            } else if (type == 'B') {
+                return new Transfer(data->fb->clone());
+            } else if (type == 'S') {
+                return new Transfer(data->fs->clone());
+            } else if (type == 'C') {
+                return new Transfer(data->fc->clone());
+            } else if (type == 'U') {
+                return new Transfer(data->b);
+            }
+            return new Transfer(data->st);
+        }
+
         ~Transfer() {
             if (type == 'I') {
                 delete data->fi;
@@ -234,12 +292,42 @@ class Transfer : public Object {
             assert(type == 'C');
             return data->fc;
         }
+
+        /** A transfer carrying the bytes of a plain struct, e.g. a partial
+         *  aggregate; every node runs the same binary, so the layout matches. */
+        template <class P>
+        static Transfer* pack(const P& pod) {
+            auto* bytes = new FixedCharArray(sizeof(P));
+            memcpy(bytes->array, &pod, sizeof(P));
+            bytes->used = sizeof(P);
+            return new Transfer(bytes);
+        }
+
+        /** The struct a transfer from pack carries. */
+        template <class P>
+        P unpack() {
+            assert(type == 'C' && data->fc->used == sizeof(P));
+            P pod;
+            memcpy(&pod, data->fc->array, sizeof(P));
+            return pod;
+        }
+
+        /** The chunk of Ts this transfer carries. */
+        template <class T>
+        typename ArrayTraits<T>::Chunk* chunk();
 };
 
+template <> inline FixedIntArray* Transfer::chunk<int>() { return int_chunk(); }
+template <> inline FixedFloatArray* Transfer::chunk<float>() { return float_chunk(); }
+template <> inline FixedBoolArray* Transfer::chunk<bool>() { return bool_chunk(); }
+template <> inline FixedCharArray* Transfer::chunk<char>() { return char_chunk(); }
+template <> inline FixedStrArray* Transfer::chunk<String*>() { return str_chunk(); }
+
 class Send : public Message {
     public:
         Transfer* transfer;
         String* key;
+        bool owns_transfer = false; // when set, the transfer is deleted with the message
 
         Send(size_t var, const char* key_) {
             kind_ = MsgKind::Send;
@@ -298,10 +386,17 @@ class Send : public Message {
         }
 
         ~Send() {
+            if (owns_transfer) delete transfer;
             delete key;
         }
 
         char type() {
             return transfer->type;
         }
+
+        /** Hands the transfer over to the caller; the message no longer deletes it. */
+        Transfer* release() {
+            owns_transfer = false;
+            return transfer;
+        }
 };
\ No newline at end of file
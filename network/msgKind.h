@@ -9,5 +9,6 @@ enum class MsgKind {
         Register,
         Directory,
         Send,
-        Finished
+        Finished,
+        Task
 };
\ No newline at end of file
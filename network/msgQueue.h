@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "message.h"
+
+/**
+ * A lock-free multi-producer, single-consumer queue of Messages. Producers
+ * link a node onto the tail with one atomic exchange, the consumer unlinks
+ * from the head without synchronising with them. The consumer only parks on
+ * the condition variable once the queue has stayed empty for a while.
+ */
+class MessageQueue : public Object {
+    public:
+        struct Node : public Pooled {
+            std::atomic<Node*> next;
+            Message* msg;
+        };
+
+        static const size_t SPINS = 64;
+
+        std::atomic<Node*> tail_; // producers append here
+        Node* head_;              // consumer only; always a consumed stub
+        std::atomic<bool> sleeping_;
+        std::mutex sleep_lock_;
+        std::condition_variable sleep_cond_;
+
+        MessageQueue() {
+            head_ = new Node();
+            head_->next.store(nullptr);
+            head_->msg = nullptr;
+            tail_.store(head_);
+            sleeping_.store(false);
+        }
+
+        /** Appends msg; safe to call from any number of threads. */
+        void push(Message* msg) {
+            Node* node = new Node();
+            node->msg = msg;
+            node->next.store(nullptr, std::memory_order_relaxed);
+            Node* prev = tail_.exchange(node, std::memory_order_acq_rel);
+            prev->next.store(node);
+            if (sleeping_.load()) {
+                std::lock_guard<std::mutex> lck(sleep_lock_);
+                sleep_cond_.notify_one();
+            }
+        }
+
+        /** Returns the oldest message, or nullptr if there is none. Consumer only. */
+        Message* try_pop() {
+            Node* next = head_->next.load();
+            if (next == nullptr) return nullptr;
+            Message* msg = next->msg;
+            delete head_;
+            head_ = next;
+            return msg;
+        }
+
+        /** Blocks until a message is available and returns it. Consumer only. */
+        Message* pop() {
+            Message* msg;
+            for (size_t i = 0; i < SPINS; i += 1) {
+                if ((msg = try_pop()) != nullptr) return msg;
+                std::this_thread::yield();
+            }
+            std::unique_lock<std::mutex> lck(sleep_lock_);
+            sleeping_.store(true);
+            sleep_cond_.wait(lck, [&] { return (msg = try_pop()) != nullptr; });
+            sleeping_.store(false);
+            return msg;
+        }
+
+        ~MessageQueue() {
+            Message* msg;
+            while ((msg = try_pop()) != nullptr) delete msg;
+            delete head_;
+        }
+};
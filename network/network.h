@@ -5,7 +5,16 @@
 #include <mutex>
 #include <map>
 #include <set>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
 #include "network_ip.h"
+#include "network_pseudo.h"
+#include "../array/kernels.h"
+#include "../array/zones.h"
+#include "../array/sketches.h"
 
 class Key : public Object {
     public:
@@ -33,120 +42,363 @@ class Key : public Object {
         }
 };
 
+/**
+ * The requests a node has outstanding with one peer, by id. A requester
+ * registers its id before sending and then waits for the reply to be
+ * delivered under that id, so any number of threads can share the peer.
+ */
+class PendingTable : public Object {
+    public:
+        std::map<size_t, Message*> replies_; // nullptr until the reply arrives
+        std::mutex lock_;
+        std::condition_variable cond_;
+
+        void expect(size_t id) {
+            std::lock_guard<std::mutex> lck(lock_);
+            replies_[id] = nullptr;
+        }
+
+        void deliver(Message* reply) {
+            std::unique_lock<std::mutex> lck(lock_);
+            auto itr = replies_.find(reply->id_);
+            assert(itr != replies_.end() && itr->second == nullptr);
+            itr->second = reply;
+            lck.unlock();
+            cond_.notify_all();
+        }
+
+        Message* wait(size_t id) {
+            std::unique_lock<std::mutex> lck(lock_);
+            auto itr = replies_.find(id);
+            while (itr->second == nullptr) cond_.wait(lck);
+            Message* reply = itr->second;
+            replies_.erase(itr);
+            return reply;
+        }
+
+        ~PendingTable() {
+            for (auto& itr : replies_) {
+                delete itr.second;
+            }
+        }
+};
+
 class Distributable : public Object {
     public:
         std::map<std::string, Transfer*> kvStore;
         size_t index;
-        NetworkIP* network;
+        NetworkIfc* network; // owned
         std::thread accept_conn_pid;
-        std::thread* individual_conns;
-        size_t pid_index;
+        std::thread reply_pid;
+        PendingTable** pending; // owned; one per peer
+        std::atomic<size_t> next_id;
         std::mutex handshake_lock;
         std::condition_variable handshake_cond;
-        bool handshake_done = false;
+        bool handshake_done = false; // set once this node is connected to all its peers
         std::mutex init_sock_lock;
         std::condition_variable init_sock_cond;
         std::set<std::string> completed_dfs;
         std::mutex complete_df_lock;
         std::condition_variable complete_df_cond;
         std::mutex map_lock;
+        std::condition_variable store_cond; // signalled, under map_lock, whenever a value is stored or a key marked finished
 
         Distributable(size_t index_var) {
             index = index_var;
-            network = new NetworkIP(&init_sock_lock, &init_sock_cond);
+            auto* ip = new NetworkIP(&init_sock_lock, &init_sock_cond);
+            network = ip;
+            init_pending_();
             accept_conn_pid = std::thread(&Distributable::start, this);
             if (index == 0) {
                 std::unique_lock<std::mutex> lck(init_sock_lock);
-                while (!network->init_sock_done) init_sock_cond.wait(lck);
+                while (!ip->init_sock_done) init_sock_cond.wait(lck);
                 lck.unlock();
             }
-            individual_conns = new std::thread[5];
-            pid_index = 0;
+        }
+
+        /** Runs this node over the given transport, e.g. a NetworkPseudo for co-located nodes. */
+        Distributable(size_t index_var, NetworkIfc* network_var) {
+            index = index_var;
+            network = network_var;
+            init_pending_();
+            accept_conn_pid = std::thread(&Distributable::start, this);
+        }
+
+        void init_pending_() {
+            network->stats.node_ = index;
+            next_id = 1;
+            pending = new PendingTable*[network->num_nodes()];
+            for (size_t i = 0; i < network->num_nodes(); i += 1) {
+                pending[i] = new PendingTable();
+            }
         }
 
         void start() {
+            network->register_node(index);
             std::unique_lock<std::mutex> lck(handshake_lock);
-            if (index == 0) {
-                network->server_init(index, 9000);
-            } else {
-                network->client_init(index, 9000 + index, "127.0.0.1", 9000);
-            }
             handshake_done = true;
             lck.unlock();
             handshake_cond.notify_all();
+            reply_pid = std::thread(&Distributable::route_replies, this);
             for (;;) {
-                int sock;
-                network->accept_connection(sock);
-                if (sock == -1) break;
-                Message* msg = network->recv_msg(sock, true);
+                Message* msg = network->recv_m();
                 if (msg->kind_ == MsgKind::Kill) {
                     delete msg;
                     break;
-                } else if (msg->kind_ == MsgKind::Finished) {
-                    Finished* finished = dynamic_cast<Finished*>(msg);
-                    std::unique_lock<std::mutex> df_lock(complete_df_lock);
-                    completed_dfs.insert(std::string(finished->key_->c_str()));
-                    df_lock.unlock();
-                    complete_df_cond.notify_all();
-                    delete finished;
-                    continue;
                 }
-                individual_conns[pid_index] = std::thread(&Distributable::listen, this, msg);
-                pid_index += 1;
+                listen(msg);
+            }
+        }
+
+        /** Hands every reply to the request waiting for it. */
+        void route_replies() {
+            for (;;) {
+                Message* msg = network->recv_reply();
+                if (msg->kind_ == MsgKind::Kill) {
+                    delete msg;
+                    return;
+                }
+                pending[msg->sender_]->deliver(msg);
+            }
+        }
+
+        /** Is this node connected to all of its peers? */
+        bool ready() {
+            std::lock_guard<std::mutex> lck(handshake_lock);
+            return handshake_done;
+        }
+
+        /** Blocks until this node is connected to all of its peers. */
+        void wait_ready() {
+            std::unique_lock<std::mutex> lck(handshake_lock);
+            while (!handshake_done) handshake_cond.wait(lck);
+        }
+
+        /** Sends a request to msg->target_ under a fresh id and waits for its
+         *  reply, recording the round trip in the network's stats. */
+        Message* request_(Message* msg) {
+            size_t node = msg->target_;
+            MsgKind kind = msg->kind_;
+            auto start = std::chrono::steady_clock::now();
+            size_t id = send_request_(msg);
+            return wait_reply_(node, id, kind, start);
+        }
+
+        /** Sends a request without waiting; returns the id its reply comes under. */
+        size_t send_request_(Message* msg) {
+            wait_ready();
+            size_t id = next_id++;
+            msg->sender_ = index;
+            msg->id_ = id;
+            pending[msg->target_]->expect(id);
+            network->send_m(msg);
+            return id;
+        }
+
+        Message* wait_reply_(size_t node, size_t id, MsgKind kind, std::chrono::steady_clock::time_point start) {
+            Message* reply = pending[node]->wait(id);
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            network->stats.round_trip(kind, node, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+            return reply;
+        }
+
+        typedef Transfer* (*TaskFn)(Distributable* store, Task* task);
+
+        /** The tasks a node can be asked to run, by name; the same in every
+         *  process since registration happens at static initialization. */
+        static std::map<std::string, TaskFn>& tasks() {
+            static std::map<std::string, TaskFn> registry;
+            return registry;
+        }
 
+        static bool register_task(const char* name, TaskFn fn) {
+            tasks()[std::string(name)] = fn;
+            return true;
+        }
+
+        /** Runs a task here; the handler returns a result the caller owns. */
+        Transfer* run_task_(Task* task) {
+            auto itr = tasks().find(std::string(task->name->c_str()));
+            assert(itr != tasks().end());
+            return itr->second(this, task);
+        }
+
+        /**
+         * Runs the named task on every node, this one included, and returns
+         * the results by node index; the caller owns the array and the
+         * results. The remote tasks are all sent before the local one runs,
+         * so the nodes work at the same time. Handlers run on the node's
+         * listener thread, so they should read only what the node holds.
+         */
+        Transfer** run_everywhere(const char* name, const char* key, size_t arg) {
+            wait_ready();
+            size_t nodes = network->num_nodes();
+            Transfer** results = new Transfer*[nodes];
+            size_t* ids = new size_t[nodes];
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < nodes; i += 1) {
+                if (i == index) continue;
+                Task* task = new Task(name, key, arg);
+                task->target_ = i;
+                ids[i] = send_request_(task);
+            }
+            Task local(name, key, arg);
+            local.sender_ = index;
+            local.target_ = index;
+            results[index] = run_task_(&local);
+            for (size_t i = 0; i < nodes; i += 1) {
+                if (i == index) continue;
+                Send* send = dynamic_cast<Send*>(wait_reply_(i, ids[i], MsgKind::Task, start));
+                results[i] = send->release();
+                delete send;
+            }
+            delete[] ids;
+            return results;
+        }
+
+        /**
+         * Runs the named task on each node i whose data[i] is not empty,
+         * with data[i] as the task's input, and returns the results by node
+         * index, nullptr for the nodes left out. As with run_everywhere the
+         * remote tasks all go out before the local one runs, so asking any
+         * number of nodes takes one round trip.
+         */
+        Transfer** run_with(const char* name, const char* key, const std::vector<std::string>& data) {
+            wait_ready();
+            size_t nodes = data.size();
+            Transfer** results = new Transfer*[nodes];
+            size_t* ids = new size_t[nodes];
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < nodes; i += 1) {
+                results[i] = nullptr;
+                if (i == index || data[i].empty()) continue;
+                Task* task = new Task(name, key, 0);
+                task->data = data[i];
+                task->target_ = i;
+                ids[i] = send_request_(task);
+            }
+            if (index < nodes && !data[index].empty()) {
+                Task local(name, key, 0);
+                local.data = data[index];
+                local.sender_ = index;
+                local.target_ = index;
+                results[index] = run_task_(&local);
+            }
+            for (size_t i = 0; i < nodes; i += 1) {
+                if (i == index || data[i].empty()) continue;
+                Send* send = dynamic_cast<Send*>(wait_reply_(i, ids[i], MsgKind::Task, start));
+                results[i] = send->release();
+                delete send;
             }
+            delete[] ids;
+            return results;
         }
 
         void listen(Message* msg) {
-            size_t sender = msg->sender_;
-            do {
-                if (msg->kind_ == MsgKind::Get) {
-                    Get* get = dynamic_cast<Get*>(msg);
-                    map_lock.lock();
-                    assert(kvStore.find(std::string(get->key->c_str())) != kvStore.end());
-                    Transfer* val = kvStore.find(std::string(get->key->c_str()))->second;
-                    map_lock.unlock();
-                    assert(get->type == val->type);
-                    Send* send = new Send(val, get->key->c_str());
-                    send->target_ = get->sender_;
-                    send->sender_ = get->target_;
-                    send->id_ = get->id_;
-                    network->send_reply(send, true);
-                    delete get;
-                    delete send;
-                } else if (msg->kind_ == MsgKind::Send) {
-                    Send* send = dynamic_cast<Send*>(msg);
-                    map_lock.lock();
-                    if (kvStore.find(std::string(send->key->c_str())) != kvStore.end()) {
-                        delete kvStore[std::string(send->key->c_str())];
-                    }
-                    kvStore[std::string(send->key->c_str())] = send->transfer;
-                    map_lock.unlock();
-                    Ack* ack = new Ack(send->target_, send->sender_, 0, send->key->c_str());
-                    delete send;
-                    network->send_reply(ack, true);
-                    delete ack;
-                } else if (msg->kind_ == MsgKind::Finished) {
-                    Finished* finished = dynamic_cast<Finished*>(msg);
-                    std::unique_lock<std::mutex> df_lock(complete_df_lock);
-                    completed_dfs.insert(std::string(finished->key_->c_str()));
-                    df_lock.unlock();
-                    complete_df_cond.notify_all();
-                    delete finished;
-                    continue;
+            if (msg->kind_ == MsgKind::Get) {
+                Get* get = dynamic_cast<Get*>(msg);
+                map_lock.lock();
+                assert(kvStore.find(std::string(get->key->c_str())) != kvStore.end());
+                Transfer* val = kvStore.find(std::string(get->key->c_str()))->second;
+                map_lock.unlock();
+                assert(get->type == val->type);
+                Send* send = new Send(val, get->key->c_str());
+                send->target_ = get->sender_;
+                send->sender_ = index;
+                send->id_ = get->id_;
+                network->send_reply(send);
+                delete get;
+            } else if (msg->kind_ == MsgKind::Send) {
+                Send* send = dynamic_cast<Send*>(msg);
+                map_lock.lock();
+                if (kvStore.find(std::string(send->key->c_str())) != kvStore.end()) {
+                    delete kvStore[std::string(send->key->c_str())];
                 }
-            } while ((msg = network->recv_msg(sender, true)) != nullptr);
+                kvStore[std::string(send->key->c_str())] = send->release();
+                map_lock.unlock();
+                store_cond.notify_all();
+                Ack* ack = new Ack(index, send->sender_, send->id_, send->key->c_str());
+                delete send;
+                network->send_reply(ack);
+            } else if (msg->kind_ == MsgKind::Finished) {
+                Finished* finished = dynamic_cast<Finished*>(msg);
+                mark_finished(finished->key_->c_str());
+                forward_(finished);
+            } else if (msg->kind_ == MsgKind::Task) {
+                Task* task = dynamic_cast<Task*>(msg);
+                Send* send = new Send(run_task_(task), task->key->c_str());
+                send->owns_transfer = true;
+                send->target_ = task->sender_;
+                send->sender_ = index;
+                send->id_ = task->id_;
+                delete task;
+                network->send_reply(send);
+            } else {
+                delete msg;
+            }
+        }
+
+        void mark_finished(const char* key) {
+            std::unique_lock<std::mutex> df_lock(complete_df_lock);
+            completed_dfs.insert(std::string(key));
+            df_lock.unlock();
+            complete_df_cond.notify_all();
+            map_lock.lock(); // so that a wait_local between its check and its wait still hears this
+            map_lock.unlock();
+            store_cond.notify_all();
+        }
+
+        bool is_finished_(const char* key) {
+            std::lock_guard<std::mutex> df_lock(complete_df_lock);
+            return completed_dfs.find(std::string(key)) != completed_dfs.end();
+        }
+
+        /** Blocks until key is marked finished on this node. */
+        void wait_finished(const char* key) {
+            std::unique_lock<std::mutex> df_lock(complete_df_lock);
+            while (completed_dfs.find(std::string(key)) == completed_dfs.end()) complete_df_cond.wait(df_lock);
         }
 
         void send_finished_update(const char* key) {
-            for (size_t i = 0; i < 5; i += 1) {
-                if (index != i) {
-                    Finished* finished = new Finished(index, i, 0, key);
-                    network->send_msg(finished, true);
-                    delete finished;
-                } else {
-                    completed_dfs.insert(std::string(key));
-                }
+            mark_finished(key);
+            broadcast(new Finished(index, index, 0, key));
+        }
+
+        /**
+         * Sends msg to every other node along a binomial tree rooted at this
+         * node: each node that receives it passes it on to its own children
+         * (see forward_), so it reaches all n nodes in log2(n) hops instead
+         * of n - 1 sends from here. The message must implement clone(), and
+         * listen must call forward_ for its kind. Takes ownership of msg.
+         */
+        void broadcast(Message* msg) {
+            wait_ready();
+            msg->sender_ = index;
+            forward_(msg);
+        }
+
+        /** Passes a broadcast on to this node's children in the tree rooted
+         *  at msg->sender_, then deletes it. */
+        void forward_(Message* msg) {
+            std::vector<size_t> children;
+            tree_children(msg->sender_, index, network->num_nodes(), children);
+            for (size_t child : children) {
+                Message* copy = dynamic_cast<Message*>(msg->clone());
+                assert(copy != nullptr);
+                copy->target_ = child;
+                network->send_m(copy);
+            }
+            delete msg;
+        }
+
+        /**
+         * The nodes that node passes a broadcast from root on to. With ranks
+         * taken relative to the root, rank r sends to r + 2^k for every 2^k > r.
+         */
+        static void tree_children(size_t root, size_t node, size_t nodes, std::vector<size_t>& out) {
+            size_t rank = (node + nodes - root) % nodes;
+            for (size_t step = 1; step < nodes; step <<= 1) {
+                if (step > rank && rank + step < nodes) out.push_back((root + rank + step) % nodes);
             }
         }
 
@@ -179,32 +431,88 @@ class Distributable : public Object {
         }
 
         void put_(size_t node, String* key, Transfer* transfer) {
-            std::unique_lock<std::mutex> lck(handshake_lock);
-            while (!handshake_done) handshake_cond.wait(lck);
-            lck.unlock();
+            wait_ready();
             if (node == index) {
                 map_lock.lock();
-                kvStore[std::string(key->c_str())] = transfer;
+                Transfer*& slot = kvStore[std::string(key->c_str())];
+                if (slot != transfer) delete slot;
+                slot = transfer;
                 map_lock.unlock();
+                store_cond.notify_all();
             } else {
                 Send* send = new Send(transfer, key->c_str());
-                send->sender_ = index;
+                send->owns_transfer = true;
                 send->target_ = node;
-                network->send_msg(send, true);
-                Ack* msg = dynamic_cast<Ack*>(network->recv_reply(node, true));
-                assert(msg->key_->equals(send->key));
-                delete transfer;
-                delete send;
+                Ack* msg = dynamic_cast<Ack*>(request_(send));
+                assert(msg->key_->equals(key));
                 delete msg;
             }
             delete key;
         }
         
+        /** Waits until a value is stored under key on this node, e.g. by a
+         *  peer's put, then removes it from the store and hands it over. */
+        Transfer* take_local(const char* key) {
+            std::string name(key);
+            std::unique_lock<std::mutex> lck(map_lock);
+            auto itr = kvStore.find(name);
+            while (itr == kvStore.end()) {
+                store_cond.wait(lck);
+                itr = kvStore.find(name);
+            }
+            Transfer* transfer = itr->second;
+            kvStore.erase(itr);
+            return transfer;
+        }
+
+        /** Waits until a value is stored under key on this node, or until
+         *  until is marked finished here; whether the value is there. */
+        bool wait_local(const char* key, const char* until) {
+            std::string name(key);
+            std::unique_lock<std::mutex> lck(map_lock);
+            while (kvStore.find(name) == kvStore.end()) {
+                if (is_finished_(until)) return kvStore.find(name) != kvStore.end();
+                store_cond.wait(lck);
+            }
+            return true;
+        }
+
         size_t get_size_t(size_t node, String* key) {
             Transfer* transfer = get_(node, 'T', key);
             return transfer->s_t();
         }
 
+        /** The size_t stored under key on node as it is now: unlike get_size_t
+         *  it is fetched every time, for values that change, never cached. */
+        size_t get_size_t_latest(size_t node, String* key) {
+            size_t val;
+            read_latest_(node, 'T', key, [&val](Transfer* transfer) { val = transfer->s_t(); });
+            return val;
+        }
+
+        /** Hands read the value stored under key on node as it is now, fetched
+         *  every time and never cached: on this node under map_lock, so a put
+         *  cannot free it meanwhile, elsewhere a copy deleted after. */
+        template <class Read>
+        void read_latest_(size_t node, char type, String* key, Read read) {
+            if (node == index) {
+                std::lock_guard<std::mutex> lck(map_lock);
+                auto itr = kvStore.find(std::string(key->c_str()));
+                assert(itr != kvStore.end() && itr->second->type == type);
+                read(itr->second);
+            } else {
+                Get* get = new Get(type, key->c_str());
+                get->target_ = node;
+                Send* send = dynamic_cast<Send*>(request_(get));
+                Transfer* transfer = send->release();
+                delete send;
+                assert(transfer->type == type);
+                read(transfer);
+                delete transfer;
+            }
+            delete key;
+        }
+
         bool get_bool(size_t node, String* key) {
             Transfer* transfer = get_(node, 'U', key);
             return transfer->b();
@@ -235,48 +543,63 @@ class Distributable : public Object {
             return transfer->char_chunk();
         }
 
+        /** The chunk of Ts stored under key on node. */
+        template <class T>
+        typename ArrayTraits<T>::Chunk* get_chunk(size_t node, String* key) {
+            return get_(node, ArrayTraits<T>::TAG, key)->template chunk<T>();
+        }
+
         Transfer* get_(size_t node, char type, String* key) {
-            Transfer* transfer;
+            Transfer* transfer = nullptr;
+            std::string name(key->c_str(), key->size());
             map_lock.lock();
-            if (kvStore.find(std::string(key->c_str())) != kvStore.end()) {
-                transfer = kvStore.find(std::string(key->c_str()))->second;
-            } else {
+            auto itr = kvStore.find(name);
+            if (itr != kvStore.end()) transfer = itr->second;
+            map_lock.unlock();
+            if (transfer == nullptr) {
                 Get* get = new Get(type, key->c_str());
-                get->sender_ = index;
                 get->target_ = node;
-                network->send_msg(get, true);
-                delete get;
-                Message* msg = network->recv_reply(node, true);
-                Send* send = dynamic_cast<Send*>(msg);
-                transfer = send->transfer;
-                kvStore[std::string(key->c_str())] = transfer;
+                Send* send = dynamic_cast<Send*>(request_(get));
+                transfer = send->release();
                 delete send;
+                map_lock.lock();
+                auto ins = kvStore.emplace(name, transfer);
+                if (!ins.second) {
+                    delete transfer;
+                    transfer = ins.first->second;
+                }
+                map_lock.unlock();
             }
-            map_lock.unlock();
             delete key;
             assert(type == transfer->type);
             return transfer;
         }
 
         ~Distributable() {
+            if (accept_conn_pid.joinable()) accept_conn_pid.join();
+            if (reply_pid.joinable()) reply_pid.join();
+            for (size_t i = 0; i < network->num_nodes(); i += 1) {
+                delete pending[i];
+            }
+            delete[] pending;
             for (std::map<std::string, Transfer*>::iterator itr = kvStore.begin(); itr != kvStore.end(); itr++) {
                 delete (itr->second);
             }
-            if (accept_conn_pid.joinable()) accept_conn_pid.join();
             delete network;
-            for (size_t i = 0; i < 5; i += 1) {
-                if (individual_conns[i].joinable()) individual_conns[i].join();
-            }
-            delete[] individual_conns;
         }
 };
 
 /*************************************************************************
- * DistEffIntArr:
- * Holds Ints in a distributed network
+ * DistEffArr:
+ * Holds Ts in a distributed network, in chunks of chunkSize spread over
+ * the nodes round robin. The chunk class and the tag chunks travel under
+ * come from ArrayTraits<T>.
  */
-class DistEffIntArr : public Object {
+template <class T>
+class DistEffArr : public Object {
     public:
+        typedef typename ArrayTraits<T>::Chunk Chunk;
+
         size_t chunkSize;
         size_t capacity;
         size_t currentChunkIdx;
@@ -284,9 +607,17 @@ class DistEffIntArr : public Object {
         String* id;
         Distributable* kvStore;
         size_t metadata_node;
-        FixedIntArray* current_chunk;
-
-        DistEffIntArr(String* id_var, Distributable* kvStore_var, size_t node, bool get) {
+        Chunk* current_chunk; // owned until handed to the store
+        std::vector<size_t> offsets; // empty while every chunk but the last is full; else
+                                     // the index each chunk starts at, plus the size
+        std::vector<Zone> zones;     // of each chunk, as far as known; see zone
+        std::vector<Bloom> blooms;   // of each chunk of strings, beside zones; see may_hold
+        bool zonesLoaded;            // false until a reader fetches zones and blooms
+        bool keepBlooms = true;      // strings only: whether chunks get Bloom filters; see no_blooms
+        std::mutex zones_lock;
+        size_t version = 0;          // the commits since lock the layout and zones are as of; see commit
+
+        DistEffArr(String* id_var, Distributable* kvStore_var, size_t node, bool get) {
             id = id_var->clone();
             kvStore = kvStore_var;
             metadata_node = node;
@@ -294,23 +625,60 @@ class DistEffIntArr : public Object {
             capacity = get ? kvStore->get_size_t(node, id->clone()->concat("-capacity")) : 1;
             currentChunkIdx = get ? kvStore->get_size_t(node, id->clone()->concat("-currentChunk")) : 0;
             numberOfElements = get ? kvStore->get_size_t(node, id->clone()->concat("-numElements")) : 0;
-            current_chunk = get ? nullptr : new FixedIntArray(chunkSize);
+            current_chunk = get ? nullptr : new Chunk(chunkSize);
+            zonesLoaded = !get;
+            if (get && kvStore->get_bool(node, id->clone()->concat("-sparse"))) {
+                FixedIntArray* counts = kvStore->get_int_chunk(node, id->clone()->concat("-counts"));
+                std::vector<size_t> rows(counts->array, counts->array + counts->used);
+                set_chunk_rows(rows);
+            }
+        }
+
+        /** Distributes the full chunks of a local chunked array, e.g. an EffCharArr. */
+        template <class Local>
+        DistEffArr(Local& from, String* id_var, Distributable* kvStore_var, size_t node, bool get) {
+            id = id_var->clone();
+            kvStore = kvStore_var;
+            metadata_node = node;
+            chunkSize = from.chunkSize;
+            capacity = from.capacity;
+            currentChunkIdx = from.currentChunkIdx;
+            numberOfElements = from.numberOfElements;
+            for (size_t i = 0; i < currentChunkIdx; i += 1) {
+                note_zone_(i, from.chunks[i]);
+                kvStore->put(i % 5, id->clone()->concat("-")->concat(i), from.chunks[i]->clone());
+            }
+            current_chunk = get ? nullptr : new Chunk(*from.chunks[currentChunkIdx]);
+            zonesLoaded = !get;
+        }
+
+        bool equals(Object* other) {
+            DistEffArr* o = dynamic_cast<DistEffArr*>(other);
+            if (o == nullptr || numberOfElements != o->numberOfElements) return false;
+            for (size_t i = 0; i < numberOfElements; i++) {
+                if (!ArrayTraits<T>::equal(get(i), o->get(i))) {
+                    return false;
+                }
+            }
+            return true;
         }
 
         /**
-         * @brief Get the column at the given index
+         * @brief Get the element at the given index
          *
          * @param idx
-         * @return Column*
+         * @return T
          */
-        int get(size_t idx) {
-            size_t chunkIdx = idx / chunkSize;
-            FixedIntArray* curChunk = kvStore->get_int_chunk(chunkIdx % 5, id->clone()->concat("-")->concat(chunkIdx));
-            return curChunk->get(idx % chunkSize);
+        T get(size_t idx) {
+            if (!offsets.empty()) {
+                size_t chunkIdx = std::upper_bound(offsets.begin(), offsets.end(), idx) - offsets.begin() - 1;
+                return get_chunk(chunkIdx)->get(idx - offsets[chunkIdx]);
+            }
+            return get_chunk(idx / chunkSize)->get(idx % chunkSize);
         }
 
-        FixedIntArray* get_chunk(size_t chunkIdx) {
-            return kvStore->get_int_chunk(chunkIdx % 5, id->clone()->concat("-")->concat(chunkIdx));
+        Chunk* get_chunk(size_t chunkIdx) {
+            return kvStore->get_chunk<T>(chunkIdx % 5, id->clone()->concat("-")->concat(chunkIdx));
         }
 
         /**
@@ -322,180 +690,139 @@ class DistEffIntArr : public Object {
             return numberOfElements;
         }
 
-        void push_back(int val) {
-            assert(current_chunk != nullptr);
-            current_chunk->pushBack(val);
-            numberOfElements += 1;
-            if (current_chunk->capacity == current_chunk->used) {
-                kvStore->put(currentChunkIdx % 5, id->clone()->concat("-")->concat(currentChunkIdx), current_chunk);
-                currentChunkIdx += 1;
-                current_chunk = new FixedIntArray(chunkSize);
-            }
+        /** The number of chunks the elements fill, the last one maybe partly. */
+        size_t num_chunks() {
+            if (!offsets.empty()) return offsets.size() - 1;
+            return (numberOfElements + chunkSize - 1) / chunkSize;
         }
 
-        void lock() {
-            kvStore->put(metadata_node, id->clone()->concat("-chunkSize"), chunkSize);
-            kvStore->put(metadata_node, id->clone()->concat("-capacity"), capacity);
-            kvStore->put(metadata_node, id->clone()->concat("-currentChunk"), currentChunkIdx);
-            kvStore->put(metadata_node, id->clone()->concat("-numElements"), numberOfElements);
-            if (current_chunk->used > 0) {
-                kvStore->put(currentChunkIdx % 5, id->clone()->concat("-")->concat(currentChunkIdx), current_chunk);
-            } else {
-                delete current_chunk;
-            }
+        /** The number of elements in chunk chunkIdx; 0 for a chunk that was never stored. */
+        size_t chunk_rows(size_t chunkIdx) {
+            if (!offsets.empty()) return offsets[chunkIdx + 1] - offsets[chunkIdx];
+            return std::min(chunkSize, numberOfElements - chunkIdx * chunkSize);
         }
 
-        /**
-         * @brief Destroy the Eff Col Arr object
-         *
-         */
-        ~DistEffIntArr() {
-            delete id;
-        }
-};
-
-/*************************************************************************
- * DistEffFloatArr:
- * Holds Floats in a distributed network
- */
-class DistEffFloatArr : public Object {
-    public:
-        size_t chunkSize;
-        size_t capacity;
-        size_t currentChunkIdx;
-        size_t numberOfElements;
-        String* id;
-        Distributable* kvStore;
-        size_t metadata_node;
-        FixedFloatArray* current_chunk;
-
-        DistEffFloatArr(String* id_var, Distributable* kvStore_var, size_t node, bool get) {
-            id = id_var->clone();
-            kvStore = kvStore_var;
-            metadata_node = node;
-            chunkSize = get ? kvStore->get_size_t(node, id->clone()->concat("-chunkSize")) : 50;
-            capacity = get ? kvStore->get_size_t(node, id->clone()->concat("-capacity")) : 1;
-            currentChunkIdx = get ? kvStore->get_size_t(node, id->clone()->concat("-currentChunk")) : 0;
-            numberOfElements = get ? kvStore->get_size_t(node, id->clone()->concat("-numElements")) : 0;
-            current_chunk = get ? nullptr : new FixedFloatArray(chunkSize);
+        /** The index of the first element of chunk chunkIdx. */
+        size_t chunk_start(size_t chunkIdx) {
+            return offsets.empty() ? chunkIdx * chunkSize : offsets[chunkIdx];
         }
 
         /**
-         * @brief Get the column at the given index
-         *
-         * @param idx
-         * @return Column*
+         * Describes an array whose chunks were stored one by one with
+         * store_chunk rather than pushed, so chunks other than the last may
+         * be short or missing: chunk k holds rows[k] elements. lock then
+         * records the layout for the readers.
          */
-        float get(size_t idx) {
-            size_t chunkIdx = idx / chunkSize;
-            FixedFloatArray* curChunk = kvStore->get_float_chunk(chunkIdx % 5, id->clone()->concat("-")->concat(chunkIdx));
-            return curChunk->get(idx % chunkSize);
+        void set_chunk_rows(const std::vector<size_t>& rows) {
+            offsets.assign(1, 0);
+            for (size_t n : rows) {
+                offsets.push_back(offsets.back() + n);
+            }
+            numberOfElements = offsets.back();
+            currentChunkIdx = rows.size();
         }
 
-        FixedFloatArray* get_chunk(size_t chunkIdx) {
-            return kvStore->get_float_chunk(chunkIdx % 5, id->clone()->concat("-")->concat(chunkIdx));
+        /** Stores a chunk as chunk chunkIdx of the array, on the node that chunk lives on. */
+        void store_chunk(size_t chunkIdx, Chunk* chunk) {
+            note_zone_(chunkIdx, chunk);
+            kvStore->put(chunkIdx % 5, id->clone()->concat("-")->concat(chunkIdx), chunk);
         }
 
         /**
-         * @brief get the size of this column
-         *
-         * @return size_t
+         * Sum, min, max and count of a locked int or float array. Each node
+         * folds the chunks it holds through the SIMD kernels and only the
+         * partial aggregates cross the network.
          */
-        size_t size() {
-            return numberOfElements;
-        }
-
-        void push_back(float val) {
-            assert(current_chunk != nullptr);
-            current_chunk->pushBack(val);
-            numberOfElements += 1;
-            if (current_chunk->capacity == current_chunk->used) {
-                kvStore->put(currentChunkIdx % 5, id->clone()->concat("-")->concat(currentChunkIdx), current_chunk);
-                currentChunkIdx += 1;
-                current_chunk = new FixedFloatArray(chunkSize);
+        template <class U = T>
+        typename KernelAgg<U>::Agg aggregate() {
+            typedef typename KernelAgg<U>::Agg Agg;
+            Transfer** partials = kvStore->run_everywhere(KernelAgg<U>::TASK, id->c_str(), num_chunks());
+            Agg total;
+            for (size_t i = 0; i < kvStore->network->num_nodes(); i += 1) {
+                total.merge(partials[i]->template unpack<Agg>());
+                delete partials[i];
             }
+            delete[] partials;
+            return total;
         }
 
-        void lock() {
-            kvStore->put(metadata_node, id->clone()->concat("-chunkSize"), chunkSize);
-            kvStore->put(metadata_node, id->clone()->concat("-capacity"), capacity);
-            kvStore->put(metadata_node, id->clone()->concat("-currentChunk"), currentChunkIdx);
-            kvStore->put(metadata_node, id->clone()->concat("-numElements"), numberOfElements);
-            if (current_chunk->used > 0) {
-                kvStore->put(currentChunkIdx % 5, id->clone()->concat("-")->concat(currentChunkIdx), current_chunk);
-            } else {
-                delete current_chunk;
+        /** The aggregate task: folds the first task->arg chunks of the array
+         *  under task->key that this node holds. */
+        static Transfer* aggregate_task_(Distributable* store, Task* task) {
+            typename KernelAgg<T>::Agg acc;
+            std::string prefix = std::string(task->key->c_str()) + "-";
+            std::lock_guard<std::mutex> lck(store->map_lock);
+            for (size_t chunkIdx = store->index; store->index < 5 && chunkIdx < task->arg; chunkIdx += 5) {
+                auto itr = store->kvStore.find(prefix + std::to_string(chunkIdx));
+                if (itr == store->kvStore.end()) continue; // an empty chunk of a filtered array
+                Chunk* chunk = itr->second->template chunk<T>();
+                Kernels::aggregate(chunk->array, chunk->used, acc);
             }
+            return Transfer::pack(acc);
         }
 
         /**
-         * @brief Destroy the Eff Col Arr object
-         *
+         * The sketches of a locked array (see ColumnSketch), from one pass
+         * on the nodes that hold its chunks: each node sketches its own
+         * chunks and only the sketches cross the network.
          */
-        ~DistEffFloatArr() {
-            delete id;
+        ColumnSketch sketch() {
+            Transfer** partials = kvStore->run_everywhere(sketch_task_name_(), id->c_str(), num_chunks());
+            ColumnSketch total;
+            for (size_t i = 0; i < kvStore->network->num_nodes(); i += 1) {
+                total.merge(partials[i]->template unpack<ColumnSketch>());
+                delete partials[i];
+            }
+            delete[] partials;
+            return total;
         }
-};
-
-/*************************************************************************
- * DistEffBoolArr:
- * Holds Bools in a distributed network
- */
-class DistEffBoolArr : public Object {
-    public:
-        size_t chunkSize;
-        size_t capacity;
-        size_t currentChunkIdx;
-        size_t numberOfElements;
-        String* id;
-        Distributable* kvStore;
-        size_t metadata_node;
-        FixedBoolArray* current_chunk;
 
-        DistEffBoolArr(String* id_var, Distributable* kvStore_var, size_t node, bool get) {
-            id = id_var->clone();
-            kvStore = kvStore_var;
-            metadata_node = node;
-            chunkSize = get ? kvStore->get_size_t(node, id->clone()->concat("-chunkSize")) : 50;
-            capacity = get ? kvStore->get_size_t(node, id->clone()->concat("-capacity")) : 1;
-            currentChunkIdx = get ? kvStore->get_size_t(node, id->clone()->concat("-currentChunk")) : 0;
-            numberOfElements = get ? kvStore->get_size_t(node, id->clone()->concat("-numElements")) : 0;
-            current_chunk = get ? nullptr : new FixedBoolArray(chunkSize);
+        /** Sketches the array and keeps the sketches on the metadata node
+         *  as the array's statistics, for stats to read back. */
+        void analyze() {
+            kvStore->put_(metadata_node, id->clone()->concat("-sketch"), Transfer::pack(sketch()));
         }
 
-        /**
-         * @brief Get the column at the given index
-         *
-         * @param idx
-         * @return Column*
-         */
-        bool get(size_t idx) {
-            size_t chunkIdx = idx / chunkSize;
-            FixedBoolArray* curChunk = kvStore->get_bool_chunk(chunkIdx % 5, id->clone()->concat("-")->concat(chunkIdx));
-            return curChunk->get(idx % chunkSize);
+        /** The statistics analyze last kept, as a copy; the array must have
+         *  been analyzed. Read anew every time, as analyze may run again. */
+        ColumnSketch stats() {
+            ColumnSketch sketch;
+            kvStore->read_latest_(metadata_node, 'C', id->clone()->concat("-sketch"),
+                                  [&sketch](Transfer* transfer) { sketch = transfer->template unpack<ColumnSketch>(); });
+            return sketch;
         }
 
-        FixedBoolArray* get_chunk(size_t chunkIdx) {
-            return kvStore->get_bool_chunk(chunkIdx % 5, id->clone()->concat("-")->concat(chunkIdx));
+        static const char* sketch_task_name_() {
+            static const std::string name = std::string("sketch-") + ArrayTraits<T>::TAG;
+            return name.c_str();
         }
 
-        /**
-         * @brief get the size of this column
-         *
-         * @return size_t
-         */
-        size_t size() {
-            return numberOfElements;
+        /** The sketch task: sketches the first task->arg chunks of the array
+         *  under task->key that this node holds. */
+        static Transfer* sketch_task_(Distributable* store, Task* task) {
+            ColumnSketch acc;
+            std::string prefix = std::string(task->key->c_str()) + "-";
+            std::lock_guard<std::mutex> lck(store->map_lock);
+            for (size_t chunkIdx = store->index; store->index < 5 && chunkIdx < task->arg; chunkIdx += 5) {
+                auto itr = store->kvStore.find(prefix + std::to_string(chunkIdx));
+                if (itr == store->kvStore.end()) continue; // an empty chunk of a filtered array
+                Chunk* chunk = itr->second->template chunk<T>();
+                for (size_t i = 0; i < chunk->numElements(); i += 1) {
+                    acc.add(ValueHash::of(chunk->get(i)));
+                }
+            }
+            return Transfer::pack(acc);
         }
 
-        void push_back(bool val) {
+        void push_back(T val) {
             assert(current_chunk != nullptr);
             current_chunk->pushBack(val);
             numberOfElements += 1;
-            if (current_chunk->capacity == current_chunk->used) {
+            if (current_chunk->size() == current_chunk->numElements()) {
+                note_zone_(currentChunkIdx, current_chunk);
                 kvStore->put(currentChunkIdx % 5, id->clone()->concat("-")->concat(currentChunkIdx), current_chunk);
                 currentChunkIdx += 1;
-                current_chunk = new FixedBoolArray(chunkSize);
+                current_chunk = new Chunk(chunkSize);
             }
         }
 
@@ -504,200 +831,246 @@ class DistEffBoolArr : public Object {
             kvStore->put(metadata_node, id->clone()->concat("-capacity"), capacity);
             kvStore->put(metadata_node, id->clone()->concat("-currentChunk"), currentChunkIdx);
             kvStore->put(metadata_node, id->clone()->concat("-numElements"), numberOfElements);
-            if (current_chunk->used > 0) {
+            kvStore->put(metadata_node, id->clone()->concat("-sparse"), !offsets.empty());
+            if (!offsets.empty()) {
+                auto* counts = new FixedIntArray(offsets.size() - 1);
+                for (size_t i = 0; i + 1 < offsets.size(); i += 1) {
+                    counts->pushBack((int) (offsets[i + 1] - offsets[i]));
+                }
+                kvStore->put(metadata_node, id->clone()->concat("-counts"), counts);
+                delete current_chunk;
+            } else if (current_chunk->numElements() > 0) {
+                note_zone_(currentChunkIdx, current_chunk);
                 kvStore->put(currentChunkIdx % 5, id->clone()->concat("-")->concat(currentChunkIdx), current_chunk);
             } else {
                 delete current_chunk;
             }
+            current_chunk = nullptr;
+            put_zones_();
         }
 
         /**
-         * @brief Destroy the Eff Col Arr object
-         *
-         */
-        ~DistEffBoolArr() {
-            delete id;
-        }
-};
-
-/*************************************************************************
- * DistEffCharArr:
- * Holds Chars in a distributed network
- */
-class DistEffCharArr : public Object {
-    public:
-        size_t chunkSize;
-        size_t capacity;
-        size_t currentChunkIdx;
-        size_t numberOfElements;
-        String* id;
-        Distributable* kvStore;
-        size_t metadata_node;
-        FixedCharArray* current_chunk;
-
-        DistEffCharArr(String* id_var, Distributable* kvStore_var, size_t node, bool get) {
-            id = id_var->clone();
-            kvStore = kvStore_var;
-            metadata_node = node;
-            chunkSize = get ? kvStore->get_size_t(node, id->clone()->concat("-chunkSize")) : 50;
-            capacity = get ? kvStore->get_size_t(node, id->clone()->concat("-capacity")) : 1;
-            currentChunkIdx = get ? kvStore->get_size_t(node, id->clone()->concat("-currentChunk")) : 0;
-            numberOfElements = get ? kvStore->get_size_t(node, id->clone()->concat("-numElements")) : 0;
-            current_chunk = get ? nullptr : new FixedCharArray(chunkSize);
-        }
-
-        /**
-         * @brief Construct a new Eff Col Arr object from another eff col arr objects
-         *
-         * @param from
+         * Readies a locked array to take more elements with push_back. They
+         * go into new chunks after the last one, even if it is short, so no
+         * chunk that a reader may hold or have cached ever changes; the
+         * layout is then described chunk by chunk, as with set_chunk_rows.
+         * commit publishes them.
          */
-        DistEffCharArr(EffCharArr& from, String* id_var, Distributable* kvStore_var, size_t node, bool get) {
-            id = id_var->clone();
-            kvStore = kvStore_var;
-            metadata_node = node;
-            chunkSize = from.chunkSize;
-            capacity = from.capacity;
-            currentChunkIdx = from.currentChunkIdx;
-            numberOfElements = from.numberOfElements;
-            for (size_t i = 0; i < currentChunkIdx; i += 1) {
-                kvStore->put(i % 5, id->clone()->concat("-")->concat(i), from.chunks[i]->clone());
+        void reopen() {
+            {
+                std::lock_guard<std::mutex> lck(zones_lock);
+                load_zones_();
+            }
+            if (offsets.empty()) {
+                std::vector<size_t> rows;
+                for (size_t chunkIdx = 0; chunkIdx < num_chunks(); chunkIdx += 1) {
+                    rows.push_back(chunk_rows(chunkIdx));
+                }
+                set_chunk_rows(rows);
             }
-            current_chunk = get ? nullptr : new FixedCharArray(*from.chunks[currentChunkIdx]);
+            zones.resize(currentChunkIdx);
+            if (blooms_()) blooms.resize(currentChunkIdx);
+            current_chunk = new Chunk(chunkSize);
         }
 
         /**
-         * @brief Get the column at the given index
-         *
-         * @param idx
-         * @return Column*
+         * Stores the elements pushed since reopen and records the new
+         * layout and zones on the metadata node under the given version,
+         * beside those of earlier versions, which readers of them still use
+         * (see at_version). Nothing is overwritten, so the array as of any
+         * version stays whole.
          */
-        char get(size_t idx) {
-            size_t chunkIdx = idx / chunkSize;
-            FixedCharArray* curChunk = kvStore->get_char_chunk(chunkIdx % 5, id->clone()->concat("-")->concat(chunkIdx));
-            return curChunk->get(idx % chunkSize);
+        void commit(size_t version_var) {
+            std::vector<size_t> rows;
+            for (size_t chunkIdx = 0; chunkIdx + 1 < offsets.size(); chunkIdx += 1) {
+                rows.push_back(chunk_rows(chunkIdx));
+            }
+            rows.resize(currentChunkIdx, chunkSize);
+            if (current_chunk->numElements() > 0) {
+                rows.push_back(current_chunk->numElements());
+                note_zone_(currentChunkIdx, current_chunk);
+                kvStore->put(currentChunkIdx % 5, id->clone()->concat("-")->concat(currentChunkIdx), current_chunk);
+            } else {
+                delete current_chunk;
+            }
+            current_chunk = nullptr;
+            set_chunk_rows(rows);
+            version = version_var;
+            auto* counts = new FixedIntArray(rows.size());
+            for (size_t n : rows) {
+                counts->pushBack((int) n);
+            }
+            kvStore->put(metadata_node, versioned_("-counts"), counts);
+            put_zones_();
         }
 
-        FixedStrArray* get_chunk(size_t chunkIdx) {
-            return kvStore->get_str_chunk(chunkIdx % 5, id->clone()->concat("-")->concat(chunkIdx));
+        /** Takes the layout of the array as of the given version, for a reader. */
+        void at_version(size_t version_var) {
+            version = version_var;
+            if (version == 0) return;
+            FixedIntArray* counts = kvStore->get_int_chunk(metadata_node, versioned_("-counts"));
+            std::vector<size_t> rows(counts->array, counts->array + counts->used);
+            set_chunk_rows(rows);
+            std::lock_guard<std::mutex> lck(zones_lock);
+            zones.clear();
+            blooms.clear();
+            zonesLoaded = false;
         }
 
-        /**
-         * @brief get the size of this column
-         *
-         * @return size_t
-         */
-        size_t size() {
-            return numberOfElements;
+        /** The key of metadata that each commit records anew: id then name,
+         *  then the version once there is one. */
+        String* versioned_(const char* name) {
+            String* key = id->clone()->concat(name);
+            return version == 0 ? key : key->concat("-")->concat(version);
         }
 
-        void push_back(char val) {
-            assert(current_chunk != nullptr);
-            current_chunk->pushBack(val);
-            numberOfElements += 1;
-            if (current_chunk->capacity == current_chunk->used) {
-                kvStore->put(currentChunkIdx % 5, id->clone()->concat("-")->concat(currentChunkIdx), current_chunk);
-                currentChunkIdx += 1;
-                current_chunk = new FixedCharArray(chunkSize);
+        /** Records the zones, and Bloom filters, of the chunks on the metadata node. */
+        void put_zones_() {
+            zones.resize(num_chunks());
+            auto* bytes = new FixedCharArray(zones.size() * sizeof(Zone));
+            memcpy(bytes->array, zones.data(), zones.size() * sizeof(Zone));
+            bytes->used = zones.size() * sizeof(Zone);
+            kvStore->put(metadata_node, versioned_("-zones"), bytes);
+            if (strings_()) {
+                blooms.resize(blooms_() ? zones.size() : 0);
+                bytes = new FixedCharArray(blooms.size() * sizeof(Bloom));
+                memcpy(bytes->array, blooms.data(), blooms.size() * sizeof(Bloom));
+                bytes->used = blooms.size() * sizeof(Bloom);
+                kvStore->put(metadata_node, versioned_("-blooms"), bytes);
             }
         }
 
-        void lock() {
-            kvStore->put(metadata_node, id->clone()->concat("-chunkSize"), chunkSize);
-            kvStore->put(metadata_node, id->clone()->concat("-capacity"), capacity);
-            kvStore->put(metadata_node, id->clone()->concat("-currentChunk"), currentChunkIdx);
-            kvStore->put(metadata_node, id->clone()->concat("-numElements"), numberOfElements);
-            if (current_chunk->used > 0) {
-                kvStore->put(currentChunkIdx % 5, id->clone()->concat("-")->concat(currentChunkIdx), current_chunk);
-            } else {
-                delete current_chunk;
-            }
+        /** The zone of chunk chunkIdx. A reader fetches the zones of all of
+         *  the chunks from the metadata node the first time it asks. */
+        Zone zone(size_t chunkIdx) {
+            std::lock_guard<std::mutex> lck(zones_lock);
+            load_zones_();
+            return chunkIdx < zones.size() ? zones[chunkIdx] : Zone();
         }
 
         /**
-         * @brief Destroy the Eff Col Arr object
-         *
+         * Whether chunk chunkIdx may hold the string of len characters at
+         * s, going by the chunk's Bloom filter, so that lookups fetch only
+         * the chunks that may match. The filters come with the zones.
          */
-        ~DistEffCharArr() {
-            delete id;
+        bool may_hold(size_t chunkIdx, const char* s, size_t len) {
+            std::lock_guard<std::mutex> lck(zones_lock);
+            load_zones_();
+            if (chunkIdx >= zones.size() || zones[chunkIdx].count == 0) return true;
+            if (chunkIdx >= blooms.size()) return zones[chunkIdx].may_hold(s, len);
+            return blooms[chunkIdx].may_hold(s, len);
         }
-};
 
-/*************************************************************************
- * DistEffStrArr::
- * Holds String values in distributed nodes. Is unmodifiable.
- */
-class DistEffStrArr : public Object {
-    public:
-        size_t chunkSize;
-        size_t capacity;
-        size_t currentChunkIdx;
-        size_t numberOfElements;
-        String* id;
-        Distributable* kvStore;
-        size_t metadata_node;
-        FixedStrArray* current_chunk;
+        void load_zones_() {
+            if (zonesLoaded) return;
+            FixedCharArray* bytes = kvStore->get_char_chunk(metadata_node, versioned_("-zones"));
+            zones.resize(bytes->used / sizeof(Zone));
+            memcpy(zones.data(), bytes->array, bytes->used);
+            if (strings_()) {
+                bytes = kvStore->get_char_chunk(metadata_node, versioned_("-blooms"));
+                blooms.resize(bytes->used / sizeof(Bloom));
+                memcpy(blooms.data(), bytes->array, bytes->used);
+                keepBlooms = blooms.size() == zones.size();
+            }
+            zonesLoaded = true;
+        }
 
-        DistEffStrArr(String* id_var, Distributable* kvStore_var, size_t node, bool get) {
-            id = id_var->clone();
-            kvStore = kvStore_var;
-            metadata_node = node;
-            chunkSize = get ? kvStore->get_size_t(node, id->clone()->concat("-chunkSize")) : 50;
-            capacity = get ? kvStore->get_size_t(node, id->clone()->concat("-capacity")) : 1;
-            currentChunkIdx = get ? kvStore->get_size_t(node, id->clone()->concat("-currentChunk")) : 0;
-            numberOfElements = get ? kvStore->get_size_t(node, id->clone()->concat("-numElements")) : 0;
-            current_chunk = get ? nullptr : new FixedStrArray(chunkSize);
+        /** Whether this is an array of strings, which may keep Bloom filters. */
+        static bool strings_() {
+            return ArrayTraits<T>::TAG == 'S';
         }
 
-        bool equals(Object* other) {
-            DistEffStrArr* o = dynamic_cast<DistEffStrArr *> (other);
-            if(o) {
-                for(size_t i = 0; i < numberOfElements; i++) {
-                    if(!get(i)->equals(o->get(i))) {
-                        return false;
-                    }
-                }
-            }
-            return numberOfElements == o->numberOfElements;
+        /** Whether the chunks have Bloom filters beside their zones. */
+        bool blooms_() {
+            return strings_() && keepBlooms;
         }
 
-        String* get(size_t idx) {
-            size_t chunkIdx = idx / chunkSize;
-            FixedStrArray* curChunk = kvStore->get_str_chunk(chunkIdx % 5, id->clone()->concat("-")->concat(chunkIdx));
-            return curChunk->get(idx % chunkSize);
+        /**
+         * Stores no Bloom filters for the chunks, only zones, whose 64 bit
+         * fingerprints then decide may_hold: less metadata for columns that
+         * are never looked up by value. For before the first chunk is stored.
+         * Every node writing the array must do the same.
+         */
+        void no_blooms() {
+            assert(zones.empty());
+            keepBlooms = false;
         }
 
-        FixedStrArray* get_chunk(size_t chunkIdx) {
-            return kvStore->get_str_chunk(chunkIdx % 5, id->clone()->concat("-")->concat(chunkIdx));
+        /** The zones (and Bloom filters) this node knows of chunks it
+         *  stored, as bytes for add_zones. */
+        std::string zone_bytes() {
+            std::string out;
+            for (size_t chunkIdx = 0; chunkIdx < zones.size(); chunkIdx += 1) {
+                if (zones[chunkIdx].count == 0) continue;
+                out.append(reinterpret_cast<const char*>(&chunkIdx), sizeof(chunkIdx));
+                out.append(reinterpret_cast<const char*>(&zones[chunkIdx]), sizeof(Zone));
+                if (blooms_()) out.append(reinterpret_cast<const char*>(&blooms[chunkIdx]), sizeof(Bloom));
+            }
+            return out;
         }
 
-        size_t size() {
-            return numberOfElements;
+        /** Learns the zones of chunks another node stored, before lock. */
+        void add_zones(const std::string& bytes) {
+            size_t pos = 0;
+            while (pos < bytes.size()) {
+                size_t chunkIdx;
+                memcpy(&chunkIdx, bytes.data() + pos, sizeof(chunkIdx));
+                pos += sizeof(chunkIdx);
+                if (zones.size() <= chunkIdx) zones.resize(chunkIdx + 1);
+                memcpy(&zones[chunkIdx], bytes.data() + pos, sizeof(Zone));
+                pos += sizeof(Zone);
+                if (!blooms_()) continue;
+                if (blooms.size() <= chunkIdx) blooms.resize(chunkIdx + 1);
+                memcpy(&blooms[chunkIdx], bytes.data() + pos, sizeof(Bloom));
+                pos += sizeof(Bloom);
+            }
         }
 
-        void push_back(String* val) {
-            assert(current_chunk != nullptr);
-            current_chunk->pushBack(val);
-            numberOfElements += 1;
-            if (current_chunk->size() == current_chunk->numElements()) {
-                kvStore->put(currentChunkIdx % 5, id->clone()->concat("-")->concat(currentChunkIdx), current_chunk);
-                currentChunkIdx += 1;
-                current_chunk = new FixedStrArray(chunkSize);
+        void note_zone_(size_t chunkIdx, Chunk* chunk) {
+            if (zones.size() <= chunkIdx) zones.resize(chunkIdx + 1);
+            Zone zone;
+            for (size_t i = 0; i < chunk->numElements(); i += 1) {
+                zone.add(chunk->get(i));
             }
+            zones[chunkIdx] = zone;
+            note_bloom_(chunkIdx, chunk, std::integral_constant<bool, ArrayTraits<T>::TAG == 'S'>());
         }
 
-        void lock() {
-            kvStore->put(metadata_node, id->clone()->concat("-chunkSize"), chunkSize);
-            kvStore->put(metadata_node, id->clone()->concat("-capacity"), capacity);
-            kvStore->put(metadata_node, id->clone()->concat("-currentChunk"), currentChunkIdx);
-            kvStore->put(metadata_node, id->clone()->concat("-numElements"), numberOfElements);
-            if (current_chunk->numElements() > 0) {
-                kvStore->put(currentChunkIdx % 5, id->clone()->concat("-")->concat(currentChunkIdx), current_chunk);
-            } else {
-                delete current_chunk;
+        void note_bloom_(size_t chunkIdx, Chunk* chunk, std::true_type) {
+            if (!keepBlooms) return;
+            if (blooms.size() <= chunkIdx) blooms.resize(chunkIdx + 1);
+            Bloom bloom;
+            for (size_t i = 0; i < chunk->numElements(); i += 1) {
+                String* v = chunk->get(i);
+                bloom.add(v->c_str(), v->size());
             }
+            blooms[chunkIdx] = bloom;
         }
 
-        ~DistEffStrArr() {
+        /** Arrays of anything but strings keep no Bloom filters. */
+        void note_bloom_(size_t, Chunk*, std::false_type) {
+        }
+
+        /**
+         * @brief Destroy the Eff Col Arr object
+         *
+         */
+        ~DistEffArr() {
+            delete current_chunk;
             delete id;
         }
-};
\ No newline at end of file
+};
+
+typedef DistEffArr<int> DistEffIntArr;
+typedef DistEffArr<float> DistEffFloatArr;
+typedef DistEffArr<bool> DistEffBoolArr;
+typedef DistEffArr<char> DistEffCharArr;
+typedef DistEffArr<String*> DistEffStrArr;
+
+static const bool dist_eff_arr_tasks_registered_ =
+        Distributable::register_task(KernelAgg<int>::TASK, DistEffArr<int>::aggregate_task_) &&
+        Distributable::register_task(KernelAgg<float>::TASK, DistEffArr<float>::aggregate_task_) &&
+        Distributable::register_task(DistEffArr<int>::sketch_task_name_(), DistEffArr<int>::sketch_task_) &&
+        Distributable::register_task(DistEffArr<float>::sketch_task_name_(), DistEffArr<float>::sketch_task_) &&
+        Distributable::register_task(DistEffArr<bool>::sketch_task_name_(), DistEffArr<bool>::sketch_task_) &&
+        Distributable::register_task(DistEffArr<String*>::sketch_task_name_(), DistEffArr<String*>::sketch_task_);
@@ -0,0 +1,41 @@
+#pragma once
+#include "../util/object.h"
+#include "message.h"
+#include "stats.h"
+
+/**
+ * The transport the key/value store runs on. Requests and one-way messages
+ * sent with send_m() are delivered to the target's recv_m(); the answer to a
+ * request travels back with send_reply(), carrying the request's id_, and is
+ * picked up by the requester with recv_reply(). Any number of requests to a
+ * peer may be outstanding. Messages handed to a transport are owned by it.
+ */
+class NetworkIfc : public Object {
+    public:
+        Stats stats; // what this node sent and received; kept up by the transport
+
+        /** Joins the cluster as node idx; returns once the node can talk to its peers. */
+        virtual void register_node(size_t idx) {}
+
+        virtual size_t index() { assert(false); }
+
+        virtual size_t num_nodes() { assert(false); }
+
+        /** Sends a request or one-way message to msg->target_. */
+        virtual void send_m(Message* msg) = 0;
+
+        /** Blocks until the next request or one-way message for this node arrives. */
+        virtual Message* recv_m() = 0;
+
+        /** Answers the request msg->target_ sent to this node. */
+        virtual void send_reply(Message* msg) = 0;
+
+        /** Blocks until the next reply to any request this node sent arrives. */
+        virtual Message* recv_reply() = 0;
+
+        /** Makes recv_m() and recv_reply() return a Kill so the node stops serving. */
+        virtual void shutdown() = 0;
+
+        /** Releases whatever connections the transport holds open. */
+        virtual void shutdown_open_conns() {}
+};
@@ -7,10 +7,14 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <netinet/tcp.h>
 #include <thread>
 #include <condition_variable>
 #include <mutex>
+#include <vector>
 #include "serial.h"
+#include "network_ifc.h"
+#include "msgQueue.h"
 
 class NodeInfo : public Object {
     public:
@@ -18,6 +22,8 @@ class NodeInfo : public Object {
         sockaddr_in address;
         int send = -1;
         int recv = -1;
+        std::mutex send_lock;  // serializes the writers sharing the send connection
+        std::mutex reply_lock; // serializes the writers sharing the recv connection
 
         ~NodeInfo() {
             if (send != -1) {
@@ -31,16 +37,29 @@ class NodeInfo : public Object {
         }
 };
 
-class NetworkIP : public Object {
+class NetworkIP : public NetworkIfc {
     public:
-        NodeInfo* nodes_;
+        NodeInfo* nodes_ = nullptr;
         size_t this_node_;
-        int sock_;
+        int sock_ = -1;
         sockaddr_in ip_;
         std::mutex* init_sock_lock;
         std::condition_variable* init_sock_cond;
         bool init_sock_done = false;
-        int num_nodes = 5;
+        size_t num_nodes_ = 5;
+        size_t server_port = 9000;
+        const char* server_adr = "127.0.0.1";
+        MessageQueue inbound_;            // requests read off the accepted connections
+        MessageQueue replies_;            // replies read off the send connections
+        std::thread accept_pid_;
+        std::vector<std::thread> readers_; // one per open connection
+        std::vector<int> accepted_;
+        std::mutex conns_lock_;
+        std::condition_variable conns_cond_;
+        size_t peers_connected_ = 0;      // peers whose send connection to us is up
+        bool closing_ = false;
+        std::vector<int> early_conns_;    // peers that connected before our Directory came
+        std::vector<Message*> early_msgs_;
 
         NetworkIP(std::mutex* mtx, std::condition_variable* cond) {
             init_sock_lock = mtx;
@@ -50,18 +69,139 @@ class NetworkIP : public Object {
         NetworkIP() {}
 
         ~NetworkIP() override {
-            close(sock_);
+            shutdown_open_conns();
+            if (accept_pid_.joinable()) accept_pid_.join();
+            for (std::thread& reader : readers_) {
+                reader.join();
+            }
+            for (int conn : accepted_) {
+                close(conn);
+            }
+            for (Message* msg : early_msgs_) {
+                delete msg;
+            }
+            if (nodes_ != nullptr) {
+                for (size_t i = 0; i < num_nodes_; i += 1) {
+                    nodes_[i].recv = -1;
+                }
+            }
+            if (sock_ != -1) close(sock_);
             delete[] nodes_;
         }
 
-        void shutdown_open_conns() {
-            for (size_t i = 0; i < num_nodes; i += 1) {
-                if (nodes_[i].send != -1) close(nodes_[i].send);
-                if (nodes_[i].recv != -1) close(nodes_[i].recv);
+        /** Stops accepting and hangs up every connection; blocked readers see end of stream. */
+        void shutdown_open_conns() override {
+            std::lock_guard<std::mutex> lck(conns_lock_);
+            if (closing_) return;
+            closing_ = true;
+            conns_cond_.notify_all();
+            if (sock_ != -1) ::shutdown(sock_, SHUT_RDWR);
+            for (int conn : accepted_) {
+                ::shutdown(conn, SHUT_RDWR);
+            }
+            if (nodes_ == nullptr) return;
+            for (size_t i = 0; i < num_nodes_; i += 1) {
+                if (nodes_[i].send != -1) ::shutdown(nodes_[i].send, SHUT_RDWR);
+            }
+        }
+
+        /** Registers with the server, then brings up the full mesh: returns once this
+         *  node has a connection to every peer and every peer has one to it. */
+        void register_node(size_t idx) override {
+            if (idx == 0) {
+                server_init(idx, server_port);
+            } else {
+                client_init(idx, server_port + idx, server_adr, server_port);
+            }
+            accept_pid_ = std::thread(&NetworkIP::accept_loop_, this);
+            std::unique_lock<std::mutex> lck(conns_lock_);
+            for (size_t i = 0; i < early_conns_.size(); i += 1) {
+                readers_.push_back(std::thread(&NetworkIP::read_conn_, this, early_conns_[i], early_msgs_[i]));
+            }
+            early_conns_.clear();
+            early_msgs_.clear();
+            lck.unlock();
+            connect_all_();
+            lck.lock();
+            while (peers_connected_ < num_nodes_ - 1 && !closing_) conns_cond_.wait(lck);
+        }
+
+        /** Opens the send connections to all peers at once. */
+        void connect_all_() {
+            std::vector<std::thread> pids;
+            for (size_t i = 0; i < num_nodes_; i += 1) {
+                if (i == this_node_) continue;
+                pids.push_back(std::thread([this, i] {
+                    std::lock_guard<std::mutex> lck(nodes_[i].send_lock);
+                    if (nodes_[i].send == -1) open_(i);
+                }));
+            }
+            for (std::thread& pid : pids) {
+                pid.join();
+            }
+        }
+
+        size_t num_nodes() override { return num_nodes_; }
+
+        void send_m(Message* msg) override {
+            send_msg(msg, true);
+            delete msg;
+        }
+
+        Message* recv_m() override {
+            return inbound_.pop();
+        }
+
+        void send_reply(Message* msg) override {
+            send_reply(msg, true);
+            delete msg;
+        }
+
+        Message* recv_reply() override {
+            return replies_.pop();
+        }
+
+        /** Accepts connections from the peers until the listening socket is shut down. */
+        void accept_loop_() {
+            for (;;) {
+                int req;
+                accept_connection(req);
+                if (req == -1) return;
+                std::lock_guard<std::mutex> lck(conns_lock_);
+                accepted_.push_back(req);
+                if (closing_) ::shutdown(req, SHUT_RDWR);
+                readers_.push_back(std::thread(&NetworkIP::read_conn_, this, req, nullptr));
             }
         }
 
-        size_t index() { return this_node_; }
+        /** Moves every message a peer sends on conn to the inbound queue, starting
+         *  with first if it was already read. A connection opens with a Register
+         *  naming the peer; replies to its requests go back on the same connection. */
+        void read_conn_(int conn, Message* first) {
+            Message* msg = first != nullptr ? first : recv_message_(conn);
+            for (; msg != nullptr; msg = recv_message_(conn)) {
+                if (msg->kind_ == MsgKind::Register) {
+                    std::unique_lock<std::mutex> lck(conns_lock_);
+                    nodes_[msg->sender_].recv = conn;
+                    peers_connected_ += 1;
+                    lck.unlock();
+                    conns_cond_.notify_all();
+                    delete msg;
+                    continue;
+                }
+                inbound_.push(msg);
+            }
+        }
+
+        /** Moves every reply a peer sends back on conn to the reply queue. */
+        void read_replies_(int conn) {
+            Message* msg;
+            while ((msg = recv_message_(conn)) != nullptr) {
+                replies_.push(msg);
+            }
+        }
+
+        size_t index() override { return this_node_; }
 
         void init_sock_(size_t port) {
             int yes=1;
@@ -100,10 +240,10 @@ class NetworkIP : public Object {
             init_sock_done = true;
             lck.unlock();
             init_sock_cond->notify_all();
-            nodes_ = new NodeInfo[num_nodes];
+            nodes_ = new NodeInfo[num_nodes_];
             nodes_[0].id = 0;
             nodes_[0].address = ip_;
-            for (size_t i = 2; i <= num_nodes; i += 1) {
+            for (size_t i = 2; i <= num_nodes_; i += 1) {
                 auto* msg = dynamic_cast<Register*>(recv_first_msg(false));
                 nodes_[msg->sender_].id = msg->sender_;
                 nodes_[msg->sender_].address.sin_family = AF_INET;
@@ -111,15 +251,15 @@ class NetworkIP : public Object {
                 inet_aton(msg->client->c_str(), &(nodes_[msg->sender_].address.sin_addr));
                 delete msg;
             }
-            auto* ports = new size_t[num_nodes - 1];
-            auto** addresses = new String*[num_nodes - 1];
-            for (size_t i = 0; i < num_nodes - 1; i += 1) {
+            auto* ports = new size_t[num_nodes_ - 1];
+            auto** addresses = new String*[num_nodes_ - 1];
+            for (size_t i = 0; i < num_nodes_ - 1; i += 1) {
                 ports[i] = ntohs(nodes_[i + 1].address.sin_port);
                 addresses[i] = new String(inet_ntoa(nodes_[i + 1].address.sin_addr));
             }
 
-            Directory ipd(num_nodes - 1, ports,addresses);
-            for (size_t i = 1; i < num_nodes; i += 1) {
+            Directory ipd(num_nodes_ - 1, ports,addresses);
+            for (size_t i = 1; i < num_nodes_; i += 1) {
                 ipd.target_ = i;
                 send_msg(&ipd, false);
             }
@@ -132,7 +272,7 @@ class NetworkIP : public Object {
             init_sock_done = true;
             lck.unlock();
             init_sock_cond->notify_all();
-            nodes_ = new NodeInfo[num_nodes];
+            nodes_ = new NodeInfo[num_nodes_];
             nodes_[0].id = 0;
             nodes_[0].address.sin_family = AF_INET;
             nodes_[0].address.sin_port = htons(server_port);
@@ -140,7 +280,21 @@ class NetworkIP : public Object {
                 assert(false && "Invalid server IP address format");
             Register msg(idx, port, inet_ntoa(ip_.sin_addr));
             send_msg(&msg, false);
-            Message* rec = recv_first_msg(false);
+            Message* rec;
+            for (;;) {
+                int req;
+                accept_connection(req);
+                no_delay_(req);
+                rec = recv_message_(req);
+                if (rec->kind_ == MsgKind::Directory) {
+                    close(req);
+                    break;
+                }
+                std::lock_guard<std::mutex> lck(conns_lock_);
+                accepted_.push_back(req);
+                early_conns_.push_back(req);
+                early_msgs_.push_back(rec);
+            }
             auto* ipd = dynamic_cast<Directory*>(rec);
             for (size_t i = 0; i < ipd->clients; i += 1) {
                 nodes_[i + 1].id = i + 1;
@@ -151,24 +305,23 @@ class NetworkIP : public Object {
             delete ipd;
         }
 
-        void shutdown() {
-            auto* kill = new Kill(this_node_, this_node_, 0);
-            int conn = socket(AF_INET, SOCK_STREAM, 0);
-            assert(conn >= 0 && "Unable to create client socket");
-            if (connect(conn, (sockaddr *) &ip_, sizeof(ip_)) < 0)
-                assert(false && "Unable to connect to remote node");
-            send_msg_(kill, conn);
-            close(conn);
-            delete kill;
+        void shutdown() override {
+            inbound_.push(new Kill(this_node_, this_node_, 0));
+            replies_.push(new Kill(this_node_, this_node_, 0));
         }
 
+        /** Sends msg on the connection to its target, opening it if needed. A kept
+         *  alive connection carries every request to that peer and a reader for
+         *  the replies coming back on it. */
         void send_msg(Message* msg, bool keepAlive) {
             NodeInfo & tgt = nodes_[msg->target_];
+            std::lock_guard<std::mutex> lck(tgt.send_lock);
             if (tgt.send == -1) {
-                tgt.send = socket(AF_INET, SOCK_STREAM, 0);
-                assert(tgt.send >= 0 && "Unable to create client socket");
-                if (connect(tgt.send, (sockaddr *) &tgt.address, sizeof(tgt.address)) < 0)
-                    assert(false && "Unable to connect to remote node");
+                if (keepAlive) {
+                    open_(msg->target_);
+                } else {
+                    tgt.send = connect_(tgt.address);
+                }
             }
             send_msg_(msg, tgt.send);
             if (!keepAlive) {
@@ -179,6 +332,7 @@ class NetworkIP : public Object {
 
         void send_reply(Message* msg, bool keepAlive) {
             NodeInfo & tgt = nodes_[msg->target_];
+            std::lock_guard<std::mutex> lck(tgt.reply_lock);
             send_msg_(msg, tgt.recv);
             if (!keepAlive) {
                 close(tgt.recv);
@@ -186,13 +340,52 @@ class NetworkIP : public Object {
             }
         }
 
+        int connect_(sockaddr_in& address) {
+            int conn = socket(AF_INET, SOCK_STREAM, 0);
+            assert(conn >= 0 && "Unable to create client socket");
+            if (connect(conn, (sockaddr *) &address, sizeof(address)) < 0)
+                assert(false && "Unable to connect to remote node");
+            no_delay_(conn);
+            return conn;
+        }
+
+        /** Opens the send connection to node, introduces this node on it and starts
+         *  reading the replies that come back. Caller holds the node's send_lock. */
+        void open_(size_t node) {
+            NodeInfo & tgt = nodes_[node];
+            tgt.send = connect_(tgt.address);
+            char adr[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &ip_.sin_addr, adr, INET_ADDRSTRLEN);
+            Register hello(this_node_, ntohs(ip_.sin_port), adr);
+            hello.target_ = node;
+            send_msg_(&hello, tgt.send);
+            std::lock_guard<std::mutex> lck(conns_lock_);
+            readers_.push_back(std::thread(&NetworkIP::read_replies_, this, tgt.send));
+        }
+
+        /** Writes the size prefix and the message with a single send. */
         void send_msg_(Message* msg, int& sock) {
             assert(sock != -1);
             size_t size = 0;
             char* buf = Serializer::serialize(msg, size);
-            send(sock, &size, sizeof(size_t), 0);
-            send(sock, buf, size, 0);
+            stats.sent(msg->kind_, msg->target_, sizeof(size_t) + size);
+            char* frame = new char[sizeof(size_t) + size];
+            memcpy(frame, &size, sizeof(size_t));
+            memcpy(frame + sizeof(size_t), buf, size);
             delete[] buf;
+            size_t sent = 0;
+            while (sent != sizeof(size_t) + size) {
+                ssize_t wr = send(sock, frame + sent, sizeof(size_t) + size - sent, MSG_NOSIGNAL);
+                if (wr <= 0) break;
+                sent += wr;
+            }
+            delete[] frame;
+        }
+
+        /** Requests are small and latency bound; don't let Nagle hold them back. */
+        void no_delay_(int sock) {
+            int yes = 1;
+            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(int));
         }
 
         Message* recv_first_msg(bool keepAlive) {
@@ -203,59 +396,39 @@ class NetworkIP : public Object {
             return msg;
         }
 
-        Message* recv_msg(int& req, bool keepAlive) {
-            Message* msg = recv_message_(req);
-            if (msg == nullptr) return nullptr;
-            NodeInfo & sender = nodes_[msg->sender_];
-            if (sender.recv != -1) {
-                close(sender.recv);
-                sender.recv = -1;
-            }
-            if (keepAlive) {
-                sender.recv = req;
-            } else {
-                close(req);
-            }
-            return msg;
-        }
-
-        Message* recv_msg(size_t index, bool keepAlive) {
-            NodeInfo & sender = nodes_[index];
-            Message* msg = recv_message_(sender.recv);
-            if (!keepAlive) {
-                close(sender.recv);
-                sender.recv = -1;
-            }
-            return msg;
-        }
-
-        Message* recv_reply(size_t index, bool keepAlive) {
-            NodeInfo & sender = nodes_[index];
-            Message* msg = recv_message_(sender.send);
-            if (!keepAlive) {
-                close(sender.send);
-                sender.send = -1;
-            }
-            return msg;
-        }
-
         void accept_connection(int& req) {
             sockaddr_in sender{};
             socklen_t addrlen = sizeof(sender);
             req = accept(sock_, (sockaddr*)&sender, &addrlen);
+            if (req != -1) no_delay_(req);
         }
 
+        /** Reads one message off req; nullptr once the peer hung up. Every
+         *  connection is read by a thread of its own, so the frame goes into a
+         *  buffer kept by that thread and grown to the largest frame seen. */
         Message* recv_message_(int& req) {
             if (req == -1) assert(false && "no established connection");
+            static thread_local std::vector<char> buf;
             size_t size = 0;
-            if (read(req, &size, sizeof(size_t)) == 0) {
+            if (!read_fully_(req, (char*) &size, sizeof(size_t))) {
                 return nullptr;
             }
-            char* buf = new char[size];
-            int rd = 0;
-            while (rd != size) rd += read(req, buf + rd, size - rd);
-            Message* msg = Serializer::deserializeMessage(buf);
-            delete[] buf;
+            if (buf.size() < size) buf.resize(size);
+            if (!read_fully_(req, buf.data(), size)) {
+                return nullptr;
+            }
+            Message* msg = Serializer::deserializeMessage(buf.data());
+            if (msg != nullptr) stats.received(msg->kind_, msg->sender_, sizeof(size_t) + size);
             return msg;
         }
+
+        bool read_fully_(int req, char* buf, size_t size) {
+            size_t rd = 0;
+            while (rd != size) {
+                ssize_t got = read(req, buf + rd, size - rd);
+                if (got <= 0) return false;
+                rd += got;
+            }
+            return true;
+        }
 };
\ No newline at end of file
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "network_ifc.h"
+#include "msgQueue.h"
+
+/**
+ * The queues shared by the nodes of an in-process cluster. Every node has an
+ * inbox for requests and one-way messages and a queue for the replies its
+ * peers send back to it.
+ */
+class MessageQueueArray : public Object {
+    public:
+        size_t num_nodes;
+        MessageQueue** inbox;   // owned
+        MessageQueue** replies; // owned
+
+        explicit MessageQueueArray(size_t nodes) {
+            num_nodes = nodes;
+            inbox = new MessageQueue*[num_nodes];
+            replies = new MessageQueue*[num_nodes];
+            for (size_t i = 0; i < num_nodes; i += 1) {
+                inbox[i] = new MessageQueue();
+                replies[i] = new MessageQueue();
+            }
+        }
+
+        ~MessageQueueArray() {
+            for (size_t i = 0; i < num_nodes; i += 1) {
+                delete inbox[i];
+                delete replies[i];
+            }
+            delete[] inbox;
+            delete[] replies;
+        }
+};
+
+/**
+ * NetworkPseudo:
+ * A transport for nodes living in the same process. Messages are handed from
+ * node to node through lock-free queues as they are, nothing is serialized.
+ * A Send that owns its chunk passes that ownership on; one that borrows its
+ * chunk from the sender's store carries a copy instead. Nothing goes on a
+ * wire, so the stats count messages but no bytes.
+ */
+class NetworkPseudo : public NetworkIfc {
+    public:
+        MessageQueueArray* queues_; // external; shared by all the nodes
+        size_t this_node_ = 0;
+
+        explicit NetworkPseudo(MessageQueueArray* queues) {
+            queues_ = queues;
+        }
+
+        void register_node(size_t idx) override {
+            assert(idx < queues_->num_nodes);
+            this_node_ = idx;
+        }
+
+        size_t index() override { return this_node_; }
+
+        size_t num_nodes() override { return queues_->num_nodes; }
+
+        void send_m(Message* msg) override {
+            stats.sent(msg->kind_, msg->target_, 0);
+            queues_->inbox[msg->target_]->push(own_(msg));
+        }
+
+        Message* recv_m() override {
+            Message* msg = queues_->inbox[this_node_]->pop();
+            stats.received(msg->kind_, msg->sender_, 0);
+            return msg;
+        }
+
+        void send_reply(Message* msg) override {
+            stats.sent(msg->kind_, msg->target_, 0);
+            queues_->replies[msg->target_]->push(own_(msg));
+        }
+
+        Message* recv_reply() override {
+            Message* msg = queues_->replies[this_node_]->pop();
+            stats.received(msg->kind_, msg->sender_, 0);
+            return msg;
+        }
+
+        void shutdown() override {
+            queues_->inbox[this_node_]->push(new Kill(this_node_, this_node_, 0));
+            queues_->replies[this_node_]->push(new Kill(this_node_, this_node_, 0));
+        }
+
+        /** Makes sure the receiver ends up owning everything msg points to. */
+        Message* own_(Message* msg) {
+            if (msg->kind_ == MsgKind::Send) {
+                Send* send = dynamic_cast<Send*>(msg);
+                if (!send->owns_transfer) {
+                    send->transfer = send->transfer->clone();
+                    send->owns_transfer = true;
+                }
+            }
+            return msg;
+        }
+};
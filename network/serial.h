@@ -5,8 +5,10 @@
 #include "../util/object.h"
 #include "../array/efficientArray.h"
 #include "message.h"
+#include "../util/lz.h"
 #include <stdlib.h>
 #include <sstream>
+#include <vector>
 #include <netinet/in.h>
 
 /**
@@ -27,6 +29,16 @@ class Serializer: public Object {
          */
         ~Serializer() override = default;
 
+        /** Flags carried in the header of a Send */
+        static const char SEND_COMPRESSED = 1; // the chunk is an LZ block, preceded by its raw and block sizes
+
+        /** Chunks of at least this many serialized bytes are compressed before they
+         *  go on the wire; set to SIZE_MAX to turn compression off. */
+        static size_t& compressThreshold() {
+            static size_t threshold = 256;
+            return threshold;
+        }
+
         static void putInBuffer(char* buffer, size_t& curIndex, unsigned char* bytes, size_t size) {
             for (size_t i = 0; i < size; i += 1, curIndex += 1) {
                 buffer[curIndex] = bytes[i];
@@ -82,58 +94,21 @@ class Serializer: public Object {
         }
 
         /**
-         * Serialize this fixed int array
+         * Serialize this fixed array of plain values: its capacity and length,
+         * then the elements as they lie in memory
          * @param arr
          * @return
          */
-        static char* serialize(FixedIntArray* arr, size_t& endIndex) {
-            size_t bufferSize = 2 * sizeof(size_t);
-            bufferSize += (arr->used) * sizeof(int);
+        template <class T>
+        static char* serialize(FixedArray<T>* arr, size_t& endIndex) {
+            static_assert(ArrayTraits<T>::POD, "only arrays of plain values are copied as bytes");
+            size_t bufferSize = 2 * sizeof(size_t) + arr->used * sizeof(T);
             size_t curIndex = 0;
             char* buffer = new char[bufferSize];
             serializeInBuffer(buffer, curIndex, arr->capacity);
             serializeInBuffer(buffer, curIndex, arr->used);
-            for (size_t wordIndex = 0; wordIndex < arr->used; wordIndex += 1) {
-                serializeInBuffer(buffer, curIndex, arr->get(wordIndex));
-            }
-            endIndex += curIndex;
-            return buffer;
-        }
-
-        /**
-         * Serialize this fixed float array
-         * @param arr
-         * @return
-         */
-        static char* serialize(FixedFloatArray* arr, size_t& endIndex) {
-            size_t bufferSize = 2 * sizeof(size_t);
-            bufferSize += (arr->used) * sizeof(float);
-            size_t curIndex = 0;
-            char* buffer = new char[bufferSize];
-            serializeInBuffer(buffer, curIndex, arr->capacity);
-            serializeInBuffer(buffer, curIndex, arr->used);
-            for (size_t wordIndex = 0; wordIndex < arr->used; wordIndex += 1) {
-                serializeInBuffer(buffer, curIndex, arr->get(wordIndex));
-            }
-            endIndex += curIndex;
-            return buffer;
-        }
-
-        /**
-         * Serialize this fixed boolean array
-         * @param arr
-         * @return
-         */
-        static char* serialize(FixedBoolArray* arr, size_t& endIndex) {
-            size_t bufferSize = 2 * sizeof(size_t);
-            bufferSize += (arr->used) * sizeof(bool);
-            size_t curIndex = 0;
-            char* buffer = new char[bufferSize];
-            serializeInBuffer(buffer, curIndex, arr->capacity);
-            serializeInBuffer(buffer, curIndex, arr->used);
-            for (size_t wordIndex = 0; wordIndex < arr->used; wordIndex += 1) {
-                serializeInBuffer(buffer, curIndex, arr->get(wordIndex));
-            }
+            memcpy(buffer + curIndex, arr->array, arr->used * sizeof(T));
+            curIndex += arr->used * sizeof(T);
             endIndex += curIndex;
             return buffer;
         }
@@ -146,7 +121,7 @@ class Serializer: public Object {
         static char* serialize(FixedStrArray* arr, size_t& endIndex) {
             size_t bufferSize = 2 * sizeof(size_t);
             for (size_t i = 0; i < arr->numElements(); i += 1) {
-                bufferSize += (arr->size() + 1);
+                bufferSize += arr->get(i)->size() + 1;
             }
             size_t curIndex = 0;
             char* buffer = new char[bufferSize];
@@ -159,51 +134,15 @@ class Serializer: public Object {
             return buffer;
         }
 
-        static char* serialize(FixedCharArray* arr, size_t& endIndex) {
-            size_t bufferSize = 2 * sizeof(size_t);
-            bufferSize += (arr->used) * sizeof(char);
-            size_t curIndex = 0;
-            char* buffer = new char[bufferSize];
-            serializeInBuffer(buffer, curIndex, arr->capacity);
-            serializeInBuffer(buffer, curIndex, arr->used);
-            for (size_t charIndex = 0; charIndex < arr->used; charIndex += 1) {
-                buffer[curIndex] = arr->get(charIndex);
-                curIndex += 1;
-            }
-            endIndex += curIndex;
-            return buffer;
-        }
-
-        static FixedIntArray* deserializeFixedIntArr(const char* buffer, size_t& curIndex) {
+        template <class T>
+        static FixedArray<T>* deserializeFixedArr(const char* buffer, size_t& curIndex) {
             size_t capacity = deserializeSizeT(buffer, curIndex);
             size_t used = deserializeSizeT(buffer, curIndex);
-            auto* arr = new FixedIntArray(capacity);
-            for (size_t i = 0; i < used; i += 1) {
-                int curVal = deserializeInt(buffer, curIndex);
-                arr->pushBack(curVal);
-            }
-            return arr;
-        }
-
-        static FixedFloatArray* deserializeFixedFloatArr(const char* buffer, size_t& curIndex) {
-            size_t capacity = deserializeSizeT(buffer, curIndex);
-            size_t used = deserializeSizeT(buffer, curIndex);
-            auto* arr = new FixedFloatArray(capacity);
-            for (size_t i = 0; i < used; i += 1) {
-                float curVal = deserializeFloat(buffer, curIndex);
-                arr->pushBack(curVal);
-            }
-            return arr;
-        }
-
-        static FixedBoolArray* deserializeFixedBoolArr(const char* buffer, size_t& curIndex) {
-            size_t capacity = deserializeSizeT(buffer, curIndex);
-            size_t used = deserializeSizeT(buffer, curIndex);
-            auto* arr = new FixedBoolArray(capacity);
-            for (size_t i = 0; i < used; i += 1) {
-                bool curVal = deserializeBool(buffer, curIndex);
-                arr->pushBack(curVal);
-            }
+            assert(used <= capacity);
+            auto* arr = new FixedArray<T>(capacity);
+            memcpy(arr->array, buffer + curIndex, used * sizeof(T));
+            arr->used = used;
+            curIndex += used * sizeof(T);
             return arr;
         }
 
@@ -212,21 +151,7 @@ class Serializer: public Object {
             size_t used = deserializeSizeT(buffer, curIndex);
             auto* arr = new FixedStrArray(capacity);
             for (size_t i = 0; i < used; i += 1) {
-                String* curVal = deserializeString(buffer, curIndex);
-                arr->pushBack(curVal);
-                delete curVal;
-            }
-            return arr;
-        }
-
-        static FixedCharArray* deserializeFixedCharArr(const char* buffer, size_t& curIndex) {
-            size_t capacity = deserializeSizeT(buffer, curIndex);
-            size_t used = deserializeSizeT(buffer, curIndex);
-            auto* arr = new FixedCharArray(capacity);
-            for (size_t i = 0; i < used; i += 1) {
-                char curVal = buffer[curIndex];
-                arr->pushBack(curVal);
-                curIndex += 1;
+                arr->array->pushBack(new String(deserializeCStr(buffer, curIndex)));
             }
             return arr;
         }
@@ -247,6 +172,8 @@ class Serializer: public Object {
                 buf = serializeFinished(dynamic_cast<Finished*>(m), size);
             } else if (m->kind_ == MsgKind::Ack) {
                 buf = serializeAck(dynamic_cast<Ack*>(m), size);
+            } else if (m->kind_ == MsgKind::Task) {
+                buf = serializeTask(dynamic_cast<Task*>(m), size);
             }
             return buf;
         }
@@ -341,7 +268,24 @@ class Serializer: public Object {
             } else {
                 assert(false);
             }
-            char* buffer = new char[1 + msgAttributesSize + 1 + s->key->size() + 1 + serializedChunkSize];
+            char flags = 0;
+            if (serializedChunkSize >= compressThreshold()) {
+                char* compressed = new char[2 * sizeof(size_t) + LZ::bound(serializedChunkSize)];
+                size_t blockSize = LZ::compress(serializedChunk, serializedChunkSize, compressed + 2 * sizeof(size_t));
+                size_t compressedSize = 0;
+                serializeInBuffer(compressed, compressedSize, serializedChunkSize);
+                serializeInBuffer(compressed, compressedSize, blockSize);
+                compressedSize += blockSize;
+                if (compressedSize < serializedChunkSize) {
+                    flags |= SEND_COMPRESSED;
+                    delete[] serializedChunk;
+                    serializedChunk = compressed;
+                    serializedChunkSize = compressedSize;
+                } else {
+                    delete[] compressed;
+                }
+            }
+            char* buffer = new char[1 + msgAttributesSize + 1 + s->key->size() + 1 + 1 + serializedChunkSize];
             size_t curIndex = 0;
             buffer[curIndex] = msgAbbr;
             curIndex += 1;
@@ -352,9 +296,10 @@ class Serializer: public Object {
             buffer[curIndex] = type;
             curIndex += 1;
             serializeInBuffer(buffer, curIndex, s->key);
-            for (size_t i = 0; i < serializedChunkSize; i += 1, curIndex += 1) {
-                buffer[curIndex] = serializedChunk[i];
-            }
+            buffer[curIndex] = flags;
+            curIndex += 1;
+            memcpy(buffer + curIndex, serializedChunk, serializedChunkSize);
+            curIndex += serializedChunkSize;
             delete[] serializedChunk;
             size += curIndex;
             return buffer;
@@ -410,6 +355,29 @@ class Serializer: public Object {
             return buffer;
         }
 
+        static char* serializeTask(Task* m, size_t& size) {
+            char msgAbbr = 'X';
+            size_t msgAttributesSize = 0;
+            char* msgAttributes = serializeMsgAttributes(m, msgAttributesSize);
+            char* buffer = new char[1 + msgAttributesSize + m->name->size() + 1 + m->key->size() + 1 + 2 * sizeof(size_t)
+                                    + m->data.size()];
+            size_t curIndex = 0;
+            buffer[0] = msgAbbr;
+            curIndex += 1;
+            for (size_t i = 0; i < msgAttributesSize; i += 1, curIndex += 1) {
+                buffer[curIndex] = msgAttributes[i];
+            }
+            delete[] msgAttributes;
+            serializeInBuffer(buffer, curIndex, m->name);
+            serializeInBuffer(buffer, curIndex, m->key);
+            serializeInBuffer(buffer, curIndex, m->arg);
+            serializeInBuffer(buffer, curIndex, m->data.size());
+            memcpy(buffer + curIndex, m->data.data(), m->data.size());
+            curIndex += m->data.size();
+            size += curIndex;
+            return buffer;
+        }
+
         static char* serializeMsgAttributes(Message* msg, size_t& endIndex) {
             size_t bufSize = sizeof(size_t) * 3;
             char* buffer = new char[bufSize];
@@ -442,6 +410,8 @@ class Serializer: public Object {
                 return deserializeFinished(buffer);
             } else if (buffer[0] == 'A') {
                 return deserializeAck(buffer);
+            } else if (buffer[0] == 'X') {
+                return deserializeTask(buffer);
             }
             return nullptr;
         }
@@ -467,9 +437,8 @@ class Serializer: public Object {
             size_t id = deserializeSizeT(buffer, curIndex);
             char type = buffer[curIndex];
             curIndex += 1;
-            char* key = deserializeChar(buffer, curIndex);
+            const char* key = deserializeCStr(buffer, curIndex);
             Get* g = new Get(type, key);
-            delete[] key;
             g->sender_ = sender;
             g->target_ = target;
             g->id_ = id;
@@ -483,25 +452,36 @@ class Serializer: public Object {
             size_t id = deserializeSizeT(buffer, curIndex);
             char type = buffer[curIndex];
             curIndex += 1;
-            char* key = deserializeChar(buffer, curIndex);
+            const char* key = deserializeCStr(buffer, curIndex);
+            char flags = buffer[curIndex];
+            curIndex += 1;
+            if (flags & SEND_COMPRESSED) {
+                size_t rawSize = deserializeSizeT(buffer, curIndex);
+                size_t compressedSize = deserializeSizeT(buffer, curIndex);
+                char* raw = scratch(rawSize);
+                if (!LZ::decompress(buffer + curIndex, compressedSize, raw, rawSize))
+                    assert(false && "Corrupt compressed chunk");
+                buffer = raw;
+                curIndex = 0;
+            }
             Send* send;
             if (type == 'T') {
                 size_t s = deserializeSizeT(buffer, curIndex);
                 send = new Send(s, key);
             } else if (type == 'I') {
-                FixedIntArray* arr = deserializeFixedIntArr(buffer, curIndex);
+                FixedIntArray* arr = deserializeFixedArr<int>(buffer, curIndex);
                 send = new Send(arr, key);
             } else if (type == 'F') {
-                FixedFloatArray* arr = deserializeFixedFloatArr(buffer, curIndex);
+                FixedFloatArray* arr = deserializeFixedArr<float>(buffer, curIndex);
                 send = new Send(arr, key);
             } else if (type == 'B') {
-                FixedBoolArray* arr = deserializeFixedBoolArr(buffer, curIndex);
+                FixedBoolArray* arr = deserializeFixedArr<bool>(buffer, curIndex);
                 send = new Send(arr, key);
             } else if (type == 'S') {
                 FixedStrArray* arr = deserializeFixedStrArr(buffer, curIndex);
                 send = new Send(arr, key);
             } else if (type == 'C') {
-                FixedCharArray* arr = deserializeFixedCharArr(buffer, curIndex);
+                FixedCharArray* arr = deserializeFixedArr<char>(buffer, curIndex);
                 send = new Send(arr, key);
             } else if (type == 'U') {
                 bool b = deserializeBool(buffer, curIndex);
@@ -509,7 +489,6 @@ class Serializer: public Object {
             } else {
                 assert(false);
             }
-            delete[] key;
             send->sender_ = sender;
             send->target_ = target;
             send->id_ = id;
@@ -551,9 +530,7 @@ class Serializer: public Object {
             size_t sender = deserializeSizeT(buffer, curIndex);
             size_t target = deserializeSizeT(buffer, curIndex);
             size_t id = deserializeSizeT(buffer, curIndex);
-            char* key = deserializeChar(buffer, curIndex);
-            auto* ack = new Ack(sender, target, id, key);
-            delete[] key;
+            auto* ack = new Ack(sender, target, id, deserializeCStr(buffer, curIndex));
             return ack;
         }
 
@@ -562,12 +539,27 @@ class Serializer: public Object {
             size_t sender = deserializeSizeT(buffer, curIndex);
             size_t target = deserializeSizeT(buffer, curIndex);
             size_t id = deserializeSizeT(buffer, curIndex);
-            char* key = deserializeChar(buffer, curIndex);
-            auto* finished = new Finished(sender, target, id, key);
-            delete[] key;
+            auto* finished = new Finished(sender, target, id, deserializeCStr(buffer, curIndex));
             return finished;
         }
 
+        static Task* deserializeTask(char* buffer) {
+            size_t curIndex = 1;
+            size_t sender = deserializeSizeT(buffer, curIndex);
+            size_t target = deserializeSizeT(buffer, curIndex);
+            size_t id = deserializeSizeT(buffer, curIndex);
+            const char* name = deserializeCStr(buffer, curIndex);
+            const char* key = deserializeCStr(buffer, curIndex);
+            size_t arg = deserializeSizeT(buffer, curIndex);
+            auto* task = new Task(name, key, arg);
+            size_t dataSize = deserializeSizeT(buffer, curIndex);
+            task->data.assign(buffer + curIndex, dataSize);
+            task->sender_ = sender;
+            task->target_ = target;
+            task->id_ = id;
+            return task;
+        }
+
         static int deserializeInt(const char* buffer, size_t& curIndex) {
             int num;
             auto *tmp = reinterpret_cast<unsigned char*>(&num);
@@ -605,12 +597,24 @@ class Serializer: public Object {
         }
 
         static String* deserializeString(const char* buffer, size_t& curIndex) {
-            char* c_str = deserializeChar(buffer, curIndex);
-            String* str = new String(c_str);
-            delete[] c_str;
+            return new String(deserializeCStr(buffer, curIndex));
+        }
+
+        /** The zero terminated string at curIndex, in place; valid as long as buffer is. */
+        static const char* deserializeCStr(const char* buffer, size_t& curIndex) {
+            const char* str = buffer + curIndex;
+            curIndex += strlen(str) + 1;
             return str;
         }
 
+        /** A buffer of at least size bytes owned by the calling thread, reused by
+         *  every call on it; for data that dies with the message being read. */
+        static char* scratch(size_t size) {
+            static thread_local std::vector<char> buffer;
+            if (buffer.size() < size) buffer.resize(size);
+            return buffer.data();
+        }
+
         static char* deserializeChar(const char* buffer, size_t& curIndex) {
             size_t strSize = 0;
             for (size_t i = curIndex; buffer[i] != '\0'; i += 1) {
@@ -0,0 +1,299 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+#include "../util/object.h"
+#include "msgKind.h"
+
+/**
+ * A log-linear histogram in the style of HdrHistogram: every power of two is
+ * split into SUB equal buckets, so a recorded value is known to within
+ * 1/SUB of itself (12.5%) from nanoseconds to centuries with a fixed 4KB of
+ * counts. Written by a single thread, read by any.
+ */
+class Histogram : public Object {
+    public:
+        static const size_t SUB_BITS = 3;
+        static const size_t SUB = 1 << SUB_BITS;
+        static const size_t BUCKETS = (64 - SUB_BITS + 1) * SUB;
+
+        std::atomic<uint64_t> counts_[BUCKETS];
+        std::atomic<uint64_t> count_;
+        std::atomic<uint64_t> sum_;
+        std::atomic<uint64_t> max_;
+
+        Histogram() {
+            for (size_t i = 0; i < BUCKETS; i += 1) counts_[i].store(0, std::memory_order_relaxed);
+            count_.store(0, std::memory_order_relaxed);
+            sum_.store(0, std::memory_order_relaxed);
+            max_.store(0, std::memory_order_relaxed);
+        }
+
+        static size_t bucket(uint64_t v) {
+            if (v < SUB) return (size_t) v;
+            size_t shift = 63 - __builtin_clzll(v) - SUB_BITS;
+            return shift * SUB + (size_t) (v >> shift);
+        }
+
+        /** The largest value that falls into bucket idx. */
+        static uint64_t bucket_top(size_t idx) {
+            if (idx < SUB) return idx;
+            size_t shift = idx / SUB - 1;
+            uint64_t mantissa = idx - shift * SUB;
+            return ((mantissa + 1) << shift) - 1;
+        }
+
+        /** Only the owning thread records. */
+        void record(uint64_t v) {
+            bump_(counts_[bucket(v)], 1);
+            bump_(count_, 1);
+            bump_(sum_, v);
+            if (v > max_.load(std::memory_order_relaxed)) max_.store(v, std::memory_order_relaxed);
+        }
+
+        void merge(Histogram* other) {
+            for (size_t i = 0; i < BUCKETS; i += 1) bump_(counts_[i], other->counts_[i].load(std::memory_order_relaxed));
+            bump_(count_, other->count_.load(std::memory_order_relaxed));
+            bump_(sum_, other->sum_.load(std::memory_order_relaxed));
+            uint64_t max = other->max_.load(std::memory_order_relaxed);
+            if (max > max_.load(std::memory_order_relaxed)) max_.store(max, std::memory_order_relaxed);
+        }
+
+        uint64_t count() { return count_.load(std::memory_order_relaxed); }
+
+        uint64_t max() { return max_.load(std::memory_order_relaxed); }
+
+        uint64_t mean() {
+            uint64_t n = count();
+            return n == 0 ? 0 : sum_.load(std::memory_order_relaxed) / n;
+        }
+
+        /** The value below which fraction q (0 to 1) of the recorded values fall. */
+        uint64_t percentile(double q) {
+            uint64_t n = count();
+            if (n == 0) return 0;
+            uint64_t rank = (uint64_t) (q * n + 0.5);
+            if (rank == 0) rank = 1;
+            uint64_t seen = 0;
+            for (size_t i = 0; i < BUCKETS; i += 1) {
+                seen += counts_[i].load(std::memory_order_relaxed);
+                if (seen >= rank) return bucket_top(i) < max() ? bucket_top(i) : max();
+            }
+            return max();
+        }
+
+        /** Single writer: a plain load and store, no locked instruction. */
+        static void bump_(std::atomic<uint64_t>& c, uint64_t n) {
+            c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+};
+
+/**
+ * Message counts and bytes per message kind and per peer, and round trip
+ * histograms per request kind and per peer. Each thread that records has a
+ * table of its own (see Stats); a snapshot is the sum of them.
+ */
+class NetCounters : public Object {
+    public:
+        static const size_t KINDS = (size_t) MsgKind::Task + 1;
+        static const size_t MAX_PEERS = 64;
+
+        struct Line {
+            std::atomic<uint64_t> sent{0};
+            std::atomic<uint64_t> bytes_sent{0};
+            std::atomic<uint64_t> received{0};
+            std::atomic<uint64_t> bytes_received{0};
+        };
+
+        Line kinds[KINDS];
+        Line peers[MAX_PEERS];
+        std::atomic<Histogram*> kind_rtt[KINDS];  // owned; made on first use
+        std::atomic<Histogram*> peer_rtt[MAX_PEERS]; // owned; made on first use
+
+        NetCounters() {
+            for (size_t i = 0; i < KINDS; i += 1) kind_rtt[i].store(nullptr);
+            for (size_t i = 0; i < MAX_PEERS; i += 1) peer_rtt[i].store(nullptr);
+        }
+
+        ~NetCounters() {
+            for (size_t i = 0; i < KINDS; i += 1) delete kind_rtt[i].load();
+            for (size_t i = 0; i < MAX_PEERS; i += 1) delete peer_rtt[i].load();
+        }
+
+        void sent(MsgKind kind, size_t peer, size_t bytes) {
+            add_(kinds[(size_t) kind].sent, kinds[(size_t) kind].bytes_sent, bytes);
+            if (peer < MAX_PEERS) add_(peers[peer].sent, peers[peer].bytes_sent, bytes);
+        }
+
+        void received(MsgKind kind, size_t peer, size_t bytes) {
+            add_(kinds[(size_t) kind].received, kinds[(size_t) kind].bytes_received, bytes);
+            if (peer < MAX_PEERS) add_(peers[peer].received, peers[peer].bytes_received, bytes);
+        }
+
+        void round_trip(MsgKind kind, size_t peer, uint64_t nanos) {
+            histogram_(kind_rtt[(size_t) kind])->record(nanos);
+            if (peer < MAX_PEERS) histogram_(peer_rtt[peer])->record(nanos);
+        }
+
+        void merge(NetCounters* other) {
+            for (size_t i = 0; i < KINDS; i += 1) merge_(kinds[i], other->kinds[i]);
+            for (size_t i = 0; i < MAX_PEERS; i += 1) merge_(peers[i], other->peers[i]);
+            for (size_t i = 0; i < KINDS; i += 1) merge_(kind_rtt[i], other->kind_rtt[i]);
+            for (size_t i = 0; i < MAX_PEERS; i += 1) merge_(peer_rtt[i], other->peer_rtt[i]);
+        }
+
+        /** Round trips of requests of the given kind; nullptr if there were none. */
+        Histogram* rtt(MsgKind kind) { return kind_rtt[(size_t) kind].load(std::memory_order_acquire); }
+
+        /** Round trips of requests to peer; nullptr if there were none. */
+        Histogram* rtt(size_t peer) {
+            return peer < MAX_PEERS ? peer_rtt[peer].load(std::memory_order_acquire) : nullptr;
+        }
+
+        static const char* kind_name(size_t kind) {
+            static const char* names[KINDS] = {"Ack", "Get", "Kill", "Register", "Directory", "Send", "Finished", "Task"};
+            return names[kind];
+        }
+
+        void dump(FILE* out, size_t node) {
+            fprintf(out, "node %zu      sent    bytes  received    bytes     rtt n  mean us   p50 us   p99 us   max us\n", node);
+            for (size_t i = 0; i < KINDS; i += 1) {
+                dump_line_(out, kind_name(i), kinds[i], kind_rtt[i].load(std::memory_order_acquire));
+            }
+            for (size_t i = 0; i < MAX_PEERS; i += 1) {
+                char name[16];
+                snprintf(name, sizeof(name), "peer %zu", i);
+                dump_line_(out, name, peers[i], peer_rtt[i].load(std::memory_order_acquire));
+            }
+        }
+
+        static void dump_line_(FILE* out, const char* name, Line& line, Histogram* rtt) {
+            uint64_t sent = line.sent.load(std::memory_order_relaxed);
+            uint64_t received = line.received.load(std::memory_order_relaxed);
+            if (sent == 0 && received == 0 && rtt == nullptr) return;
+            fprintf(out, "  %-10s %8llu %8llu %9llu %8llu", name, (unsigned long long) sent,
+                    (unsigned long long) line.bytes_sent.load(std::memory_order_relaxed), (unsigned long long) received,
+                    (unsigned long long) line.bytes_received.load(std::memory_order_relaxed));
+            if (rtt != nullptr) {
+                fprintf(out, "  %8llu %8.1f %8.1f %8.1f %8.1f", (unsigned long long) rtt->count(), rtt->mean() / 1e3,
+                        rtt->percentile(0.5) / 1e3, rtt->percentile(0.99) / 1e3, rtt->max() / 1e3);
+            }
+            fprintf(out, "\n");
+        }
+
+        static void add_(std::atomic<uint64_t>& count, std::atomic<uint64_t>& bytes, size_t n) {
+            Histogram::bump_(count, 1);
+            Histogram::bump_(bytes, n);
+        }
+
+        static void merge_(Line& into, Line& from) {
+            Histogram::bump_(into.sent, from.sent.load(std::memory_order_relaxed));
+            Histogram::bump_(into.bytes_sent, from.bytes_sent.load(std::memory_order_relaxed));
+            Histogram::bump_(into.received, from.received.load(std::memory_order_relaxed));
+            Histogram::bump_(into.bytes_received, from.bytes_received.load(std::memory_order_relaxed));
+        }
+
+        static void merge_(std::atomic<Histogram*>& into, std::atomic<Histogram*>& from) {
+            Histogram* other = from.load(std::memory_order_acquire);
+            if (other != nullptr) histogram_(into)->merge(other);
+        }
+
+        /** The histogram in slot, made by its (only) writer the first time. */
+        static Histogram* histogram_(std::atomic<Histogram*>& slot) {
+            Histogram* h = slot.load(std::memory_order_relaxed);
+            if (h == nullptr) {
+                h = new Histogram();
+                slot.store(h, std::memory_order_release);
+            }
+            return h;
+        }
+};
+
+/**
+ * The wire statistics of one node. Recording touches only counters private
+ * to the calling thread, so the hot path takes no lock and shares no cache
+ * line; snapshot() adds up every thread's table. dump_every() prints a
+ * snapshot at a fixed interval until the node goes away.
+ */
+class Stats : public Object {
+    public:
+        size_t id_;   // tells this node's tables apart in the threads' caches
+        size_t node_ = 0;
+        std::mutex lock_;
+        std::vector<NetCounters*> tables_; // owned; one per recording thread
+        std::thread dumper_;
+        std::condition_variable dump_cond_;
+        bool stopping_ = false;
+
+        Stats() {
+            static std::atomic<size_t> next_id(1);
+            id_ = next_id++;
+        }
+
+        ~Stats() {
+            if (dumper_.joinable()) {
+                {
+                    std::lock_guard<std::mutex> lck(lock_);
+                    stopping_ = true;
+                }
+                dump_cond_.notify_all();
+                dumper_.join();
+            }
+            for (NetCounters* table : tables_) delete table;
+        }
+
+        void sent(MsgKind kind, size_t peer, size_t bytes) { local_()->sent(kind, peer, bytes); }
+
+        void received(MsgKind kind, size_t peer, size_t bytes) { local_()->received(kind, peer, bytes); }
+
+        void round_trip(MsgKind kind, size_t peer, uint64_t nanos) { local_()->round_trip(kind, peer, nanos); }
+
+        /** The sum of all threads' counters so far; the caller deletes it. */
+        NetCounters* snapshot() {
+            auto* sum = new NetCounters();
+            std::lock_guard<std::mutex> lck(lock_);
+            for (NetCounters* table : tables_) sum->merge(table);
+            return sum;
+        }
+
+        void dump(FILE* out) {
+            NetCounters* snap = snapshot();
+            snap->dump(out, node_);
+            delete snap;
+        }
+
+        /** Dumps a snapshot to out every millis milliseconds. */
+        void dump_every(size_t millis, FILE* out) {
+            assert(!dumper_.joinable());
+            dumper_ = std::thread([this, millis, out]() {
+                std::unique_lock<std::mutex> lck(lock_);
+                while (!stopping_) {
+                    if (dump_cond_.wait_for(lck, std::chrono::milliseconds(millis)) == std::cv_status::timeout) {
+                        lck.unlock();
+                        dump(out);
+                        lck.lock();
+                    }
+                }
+            });
+        }
+
+        /** This thread's table for this node, registered on first use. Ids
+         *  are never reused, so an entry left by a node that is gone is
+         *  never looked up again. */
+        NetCounters* local_() {
+            static thread_local std::unordered_map<size_t, NetCounters*> tables;
+            NetCounters*& table = tables[id_];
+            if (table != nullptr) return table;
+            table = new NetCounters();
+            std::lock_guard<std::mutex> lck(lock_);
+            tables_.push_back(table);
+            return table;
+        }
+};
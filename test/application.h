@@ -139,102 +139,49 @@ class FileReader : public Writer {
 };
 
 /****************************************************************************/
-class Adder : public Reader {
-    public:
-
-        std::map<std::string, size_t> *map_;  // String to Num map;  Num holds an int
-
-        explicit Adder(std::map<std::string, size_t> *map) {
-            map_ = map;
-        }
-
-        bool visit(Row &r) {
-            String *word = r.get_string(0);
-            assert(word != nullptr);
-            size_t num = (map_->find(std::string(word->c_str())) != map_->end()) ?
-                         (*map_)[std::string(word->c_str())] : 0;
-            (*map_)[std::string(word->c_str())] = num + 1;
-            //changed this to true
-            return true;
-        }
-};
-
+/** Collects the (word, count) rows of a group-by; every word comes once. */
 class Combine : public Reader {
     public:
 
-        std::map<std::string, size_t> *map_;  // String to Num map;  Num holds an int
-
-        explicit Combine(std::map<std::string, size_t> *map) {
-            map_ = map;
-        }
-
-        bool visit(Row &r) {
-            String *word = r.get_string(0);
-            size_t count = r.get_int(1);
-            assert(word != nullptr);
-            (*map_)[std::string(word->c_str())] += count;
-            return true;
-        }
-};
-
-/***************************************************************************/
-class Summer : public Writer {
-    public:
-        std::map<std::string, size_t>::iterator itr;
-        std::map<std::string, size_t>::iterator end;
-
-        explicit Summer(std::map<std::string, size_t> *map) {
-            itr = map->begin();
-            end = map->end();
-        }
+        std::vector<std::pair<std::string, size_t>> *counts_;
 
-        void next() {
-            assert(!done());
-            itr++;
+        explicit Combine(std::vector<std::pair<std::string, size_t>> *counts) {
+            counts_ = counts;
         }
 
-        const char *k() const {
-            return itr->first.c_str();
-        }
-
-        int v() const {
-            return itr->second;
-        }
-
-        void visit(Row &r) override {
-            const char *key = k();
-            auto *str = new String(key);
-            size_t value = v();
-            r.set(0, str);
-            r.set(1, (int) value);
-            next();
-        }
-
-        bool done() override {
-            return itr == end;
+        void visit_batch(Batch &b) override {
+            FixedStrArray *words = b.str_col(0);
+            FixedIntArray *counts = b.int_col(1);
+            for (size_t i = 0; i < b.rows; ++i) {
+                String *word = words->get(i);
+                assert(word != nullptr);
+                counts_->emplace_back(std::string(word->c_str(), word->size()), counts->get(i));
+            }
         }
 };
 
 /****************************************************************************
  * Calculate a word count for given file:
  *   1) read the data (single node)
- *   2) produce word counts per homed chunks, in parallel
- *   3) combine the results
+ *   2) count the words with a group-by: every node counts its own chunks,
+ *      as they are stored while the data is still being read, and
+ *      finishes the words that hash to it
+ *   3) print the counts (master node)
  **********************************************************author: pmaj ****/
 class WordCount : public Application {
     public:
         static const size_t BUFSIZE = 1024;
         Key *in;
-        char *file_name;
+        const char *file_name;
         bool prt = false;
 
-        WordCount(size_t idx, KDStore *net, char *filename) :
+        WordCount(size_t idx, KDStore *net, const char *filename) :
                 Application(idx, net) {
             in = new Key("data", 0);
             file_name = filename;
         }
 
-        WordCount(size_t idx, KDStore *net, char *filename, bool print) :
+        WordCount(size_t idx, KDStore *net, const char *filename, bool print) :
                 Application(idx, net) {
             assert(print);
             prt = print;
@@ -246,63 +193,34 @@ class WordCount : public Application {
             delete in;
         }
 
-        /** The master nodes reads the input, then all of the nodes count. */
+        /** The master node reads the input on a thread of its own while all
+         *  of the nodes count the words stored so far (see KDStore::stream). */
         void run_() override {
             assert(file_name != nullptr);
-            if (index == 0) {
-                FileReader fr{file_name};
-                delete DistDataFrame::fromVisitor(in, kd, "S", &fr);
-            }
-            local_count();
-            reduce();
-        }
-
-        /** Compute word counts on the local node and build a data frame. */
-        void local_count() {
-            DistDataFrame *words = kd->waitAndGet(*in);
-            auto *map = new std::map<std::string, size_t>();
-            Adder add(map);
-            words->local_map(&add);
+            std::thread reader;
+            if (index == 0) reader = std::thread(&WordCount::read_, this);
+            DistDataFrame *words = kd->stream(*in, "S");
+            Key out("wc-counts", 0);
+            DistDataFrame *counts = words->group_by({0}, {Aggregate::count()}, out);
+            if (reader.joinable()) reader.join();
+            if (index == 0 && prt) print(counts);
+            delete counts;
             delete words;
-            Summer cnt(map);
-            auto *key = new String("wc-map-");
-            String *okStr = key->clone()->concat(index);
-            Key *ok = new Key(okStr->c_str(), 0);
-            delete okStr;
-            delete key;
-            delete DistDataFrame::fromVisitor(ok, kd, "SI", &cnt);
-            delete ok;
-            delete map;
         }
 
-        /** Merge the data frames of all nodes */
-        void reduce() {
-            if (index != 0) return;
-            std::map<std::string, size_t> map;
-            auto *key = new String("wc-map-");
-            String *ownStr = key->clone()->concat((size_t) 0);
-            Key *own = new Key(ownStr->c_str(), 0);
-            delete ownStr;
-            merge(kd->get(*own), &map);
-            for (size_t i = 1; i < 5; ++i) { // merge other nodes
-                String *okStr = key->clone()->concat(i);
-                Key *ok = new Key(okStr->c_str(), 0);
-                delete okStr;
-                merge(kd->waitAndGet(*ok), &map);
-                delete ok;
-            }
-            if (prt) {
-                for (auto & itr : map) {
-                    std::cout<<itr.first<<" : "<<itr.second<<"\n";
-                }
-            }
-            delete key;
-            delete own;
+        void read_() {
+            FileReader fr{file_name};
+            delete DistDataFrame::fromVisitor(in, kd, "S", &fr);
         }
 
-        static void merge(DistDataFrame *df, std::map<std::string, size_t> *m) {
-            Combine add(m);
-            df->map(&add);
-            delete df;
+        /** Prints the counts in word order. */
+        static void print(DistDataFrame *counts) {
+            std::vector<std::pair<std::string, size_t>> sorted;
+            Combine add(&sorted);
+            counts->map(&add);
+            std::sort(sorted.begin(), sorted.end());
+            for (auto & itr : sorted) {
+                std::cout<<itr.first<<" : "<<itr.second<<"\n";
+            }
         }
 }; // WordcountDemo
@@ -3,6 +3,7 @@
 #include "../dataframe/dataframe.h"
 #include "application.h"
 #include <stdio.h>
+#include <functional>
 
 /**
  * The first four tests test functionality of serializing
@@ -103,6 +104,74 @@ void testMessageSend() {
     delete s;
 }
 
+/**
+ * Every chunk type survives a trip through a Send, including strings longer
+ * than the chunk's capacity.
+ */
+template <class T>
+void roundTrip(typename ArrayTraits<T>::Chunk* arr) {
+    Send* s = new Send(arr, "typed");
+    s->owns_transfer = true;
+    size_t size = 0;
+    char* serializedMessage = Serializer::serializeSend(s, size);
+    Send* send = dynamic_cast<Send*>(Serializer::deserializeMessage(serializedMessage));
+    send->owns_transfer = true;
+    assert(send->type() == ArrayTraits<T>::TAG);
+    assert(send->transfer->chunk<T>()->equals(arr));
+    delete[] serializedMessage;
+    delete send;
+    delete s;
+}
+
+void testMessageSendTyped() {
+    auto* ints = new FixedIntArray(4);
+    auto* floats = new FixedFloatArray(4);
+    auto* bools = new FixedBoolArray(4);
+    auto* chars = new FixedCharArray(4);
+    auto* strs = new FixedStrArray(2);
+    for (size_t i = 0; i < 3; i += 1) {
+        ints->pushBack(-(int) i);
+        floats->pushBack(i + 0.5f);
+        bools->pushBack(i % 2 == 0);
+        chars->pushBack('a' + i);
+    }
+    String longer("a string well over the capacity of the chunk it travels in");
+    strs->pushBack(&longer);
+    roundTrip<int>(ints);
+    roundTrip<float>(floats);
+    roundTrip<bool>(bools);
+    roundTrip<char>(chars);
+    roundTrip<String*>(strs);
+}
+
+void testMessageSendCompressed() {
+    auto* arr = new FixedStrArray(500);
+    for (size_t i = 0; i < 500; i++) {
+        String word("word-");
+        word.concat(i % 7);
+        arr->pushBack(&word);
+    }
+    Send* s = new Send(arr, "big");
+    s->id_ = 3;
+    size_t size = 0;
+    char* serializedMessage = Serializer::serializeSend(s, size);
+    size_t raw = 0;
+    delete[] Serializer::serialize(arr, raw);
+    assert(size < raw);
+    Send* send = dynamic_cast<Send*>(Serializer::deserializeMessage(serializedMessage));
+    assert(3 == send->id_);
+    assert(strcmp("big", send->key->c_str()) == 0);
+    assert(500 == send->transfer->str_chunk()->numElements());
+    for (size_t i = 0; i < 500; i++) {
+        assert(send->transfer->str_chunk()->get(i)->equals(arr->get(i)));
+    }
+    delete[] serializedMessage;
+    delete send->transfer;
+    delete send;
+    delete s->transfer;
+    delete s;
+}
+
 void testMessageRegister() {
     size_t sender = 90;
     size_t id = 92;
@@ -123,73 +192,1431 @@ void testMessageRegister() {
     delete m;
 }
 
-/**
- * The next test tests the Trivial application.
- */
-void testTrivial() {
+/** Runs body on a five-node cluster whose nodes newNode builds, then shuts
+ *  the cluster down. */
+void withNodes(std::function<KDStore*(size_t)> newNode, std::function<void(KDStore**)> body) {
     auto** kds = new KDStore*[5];
-    auto* pids = new std::thread[5];
-    auto** wcs = new Trivial*[5];
-    for (size_t i = 0; i < 5; i += 1) {
-        kds[i] = new KDStore(i);
-        wcs[i] = new Trivial(i, kds[i]);
-    }
-    for (size_t i = 0; i < 5; i += 1) {
-        pids[i] = std::thread(&Trivial::run_, wcs[i]);
-    }
     for (size_t i = 0; i < 5; i += 1) {
-        pids[i].join();
+        kds[i] = newNode(i);
     }
+    body(kds);
     for (size_t i = 0; i < 5; i += 1) {
         kds[i]->kvStore->network->shutdown();
         kds[i]->kvStore->network->shutdown_open_conns();
     }
     for (size_t i = 0; i < 5; i += 1) {
-        delete wcs[i];
         delete kds[i];
     }
-    delete[] wcs;
     delete[] kds;
-    delete[] pids;
+}
+
+/** Runs body on a five-node cluster whose nodes talk over sockets. */
+void withSocketCluster(std::function<void(KDStore**)> body) {
+    withNodes([](size_t i) { return new KDStore(i); }, body);
+}
+
+/** Runs body on a five-node cluster whose nodes talk through in-process
+ *  queues. */
+void withCluster(std::function<void(KDStore**)> body) {
+    auto* queues = new MessageQueueArray(5);
+    withNodes([queues](size_t i) { return new KDStore(i, new NetworkPseudo(queues)); }, body);
+    delete queues;
+}
+
+/** Runs step(i) for every node i of a five-node cluster, each on a thread
+ *  of its own, as the nodes of an application run, and waits for them. */
+void onEachNode(std::function<void(size_t)> step) {
+    std::thread pids[5];
+    for (size_t i = 0; i < 5; i += 1) {
+        pids[i] = std::thread(step, i);
+    }
+    for (size_t i = 0; i < 5; i += 1) {
+        pids[i].join();
+    }
+}
+
+/** Runs the Trivial application on every node of kds. */
+void runTrivial(KDStore** kds) {
+    onEachNode([&](size_t i) {
+        Trivial app(i, kds[i]);
+        app.run_();
+    });
+}
+
+/** Runs the WordCount application over 100k.txt on every node of kds and
+ *  checks the counts its group-by stored. */
+void countWords(KDStore** kds) {
+    onEachNode([&](size_t i) {
+        WordCount app(i, kds[i], "100k.txt");
+        app.run_();
+    });
+    Key key("wc-counts", 0);
+    DistDataFrame* counts = kds[0]->get(key);
+    std::vector<std::pair<std::string, size_t>> words;
+    Combine add(&words);
+    counts->map(&add);
+    std::map<std::string, size_t> byWord(words.begin(), words.end());
+    size_t total = 0;
+    for (auto& word : words) total += word.second;
+    assert(words.size() == 463 && byWord.size() == 463 && total == 10000);
+    assert(byWord["et"] == 153 && byWord["ipsum"] == 51 && byWord["Lorem"] == 10);
+    delete counts;
 }
 
 /**
- * The next test tests the WordCount application.
+ * The next tests run the Trivial and WordCount applications, first with the
+ * nodes talking over sockets and then through in-process queues.
  */
+void testTrivial() {
+    withSocketCluster(runTrivial);
+}
+
 void testWordCount() {
-    auto** kds = new KDStore*[5];
-    auto* pids = new std::thread[5];
-    auto** wcs = new WordCount*[5];
-    for (size_t i = 0; i < 5; i += 1) {
-        kds[i] = new KDStore(i);
-        wcs[i] = new WordCount(i, kds[i], "100k.txt");
+    withSocketCluster(countWords);
+}
+
+void testTrivialPseudo() {
+    withCluster(runTrivial);
+}
+
+void testWordCountPseudo() {
+    withCluster(countWords);
+}
+
+/**
+ * Many threads of one node fetch chunks from the same peer at once; each must
+ * get back the chunk it asked for.
+ */
+void fetchChunks(Distributable* kv, size_t first, size_t step, size_t count) {
+    for (size_t i = first; i < count; i += step) {
+        FixedIntArray* arr = kv->get_int_chunk(1, (new String("conc-"))->concat(i));
+        assert(arr->used == 3);
+        assert(arr->get(0) == (int) i && arr->get(2) == (int) i + 2);
     }
-    for (size_t i = 0; i < 5; i += 1) {
-        pids[i] = std::thread(&WordCount::run_, wcs[i]);
+}
+
+void testConcurrentRequests() {
+    size_t threads = 8;
+    size_t chunks = 400;
+    withSocketCluster([&](KDStore** kds) {
+        for (size_t i = 0; i < chunks; i += 1) {
+            auto* arr = new FixedIntArray(3);
+            for (size_t j = 0; j < 3; j += 1) {
+                arr->pushBack(i + j);
+            }
+            kds[1]->kvStore->put(1, (new String("conc-"))->concat(i), arr);
+        }
+        std::vector<std::thread> pids;
+        for (size_t i = 0; i < threads; i += 1) {
+            pids.push_back(std::thread(fetchChunks, kds[0]->kvStore, i, threads, chunks));
+        }
+        for (std::thread& pid : pids) {
+            pid.join();
+        }
+    });
+}
+
+/** A transport whose startup, once begun, holds until the test lets it go on. */
+class HeldStart : public NetworkPseudo {
+    public:
+        std::atomic<bool> begun_;
+        std::atomic<bool> go_;
+
+        explicit HeldStart(MessageQueueArray* queues) : NetworkPseudo(queues), begun_(false), go_(false) {}
+
+        void register_node(size_t idx) override {
+            begun_ = true;
+            while (!go_) std::this_thread::yield();
+            NetworkPseudo::register_node(idx);
+        }
+};
+
+/**
+ * Once a node reports ready it holds a connection to every peer and every
+ * peer holds one to it; while its startup is still going on, asking whether
+ * it is ready does not wait for it.
+ */
+void testMeshStartup() {
+    withSocketCluster([](KDStore** kds) {
+        for (size_t i = 0; i < 5; i += 1) {
+            kds[i]->wait_ready();
+            assert(kds[i]->ready());
+            auto* ip = dynamic_cast<NetworkIP*>(kds[i]->kvStore->network);
+            assert(ip->peers_connected_ == 4);
+            for (size_t j = 0; j < 5; j += 1) {
+                if (j != i) assert(ip->nodes_[j].send != -1 && ip->nodes_[j].recv != -1);
+            }
+        }
+    });
+    auto* queues = new MessageQueueArray(1);
+    auto* held = new HeldStart(queues);
+    auto* node = new Distributable(0, held);
+    while (!held->begun_) std::this_thread::yield();
+    assert(!node->ready());
+    held->go_ = true;
+    node->wait_ready();
+    assert(node->ready());
+    node->network->shutdown();
+    delete node;
+    delete queues;
+}
+
+/**
+ * A broadcast tree reaches every node other than the root exactly once, and
+ * a broadcast over an in-process cluster marks the key finished everywhere.
+ */
+void testBroadcast() {
+    for (size_t nodes = 1; nodes <= 16; nodes += 1) {
+        for (size_t root = 0; root < nodes; root += 1) {
+            std::vector<size_t> seen(nodes, 0);
+            for (size_t node = 0; node < nodes; node += 1) {
+                std::vector<size_t> children;
+                Distributable::tree_children(root, node, nodes, children);
+                for (size_t child : children) seen[child] += 1;
+            }
+            for (size_t node = 0; node < nodes; node += 1) {
+                assert(seen[node] == (node == root ? 0 : 1));
+            }
+        }
     }
-    for (size_t i = 0; i < 5; i += 1) {
-        pids[i].join();
+    auto* queues = new MessageQueueArray(7);
+    auto** nodes = new Distributable*[7];
+    for (size_t i = 0; i < 7; i += 1) {
+        nodes[i] = new Distributable(i, new NetworkPseudo(queues));
     }
-    for (size_t i = 0; i < 5; i += 1) {
-        kds[i]->kvStore->network->shutdown();
-        kds[i]->kvStore->network->shutdown_open_conns();
+    nodes[3]->send_finished_update("bcast");
+    for (size_t i = 0; i < 7; i += 1) {
+        std::unique_lock<std::mutex> lck(nodes[i]->complete_df_lock);
+        while (nodes[i]->completed_dfs.count("bcast") == 0) nodes[i]->complete_df_cond.wait(lck);
     }
-    for (size_t i = 0; i < 5; i += 1) {
-        delete wcs[i];
-        delete kds[i];
+    for (size_t i = 0; i < 7; i += 1) {
+        nodes[i]->network->shutdown();
     }
-    delete[] wcs;
-    delete[] kds;
-    delete[] pids;
+    for (size_t i = 0; i < 7; i += 1) {
+        delete nodes[i];
+    }
+    delete[] nodes;
+    delete queues;
+}
+
+/**
+ * Pool blocks are reused once freed, also when another thread frees them, and
+ * large requests fall through to the heap.
+ */
+void testPool() {
+    void* a = Pool::alloc(40);
+    Pool::free(a, 40);
+    assert(Pool::alloc(48) == a);
+    Pool::free(a, 48);
+    std::vector<String*> strs;
+    for (size_t i = 0; i < 1000; i += 1) {
+        strs.push_back((new String("pooled-"))->concat(i));
+    }
+    std::thread other([&strs]() {
+        for (String* str : strs) delete str;
+    });
+    other.join();
+    String* str = (new String("pooled-"))->concat(999);
+    assert(strcmp(str->c_str(), "pooled-999") == 0);
+    delete str;
+    void* big = Pool::alloc(Pool::MAX_SIZE + 1);
+    memset(big, 0, Pool::MAX_SIZE + 1);
+    Pool::free(big, Pool::MAX_SIZE + 1);
+}
+
+/**
+ * Histogram buckets bound their values to within an eighth, and the stats
+ * count every request, reply and round trip between two nodes.
+ */
+void testStats() {
+    for (uint64_t v = 1; v < (1ull << 40); v = v * 3 + 1) {
+        size_t idx = Histogram::bucket(v);
+        assert(v <= Histogram::bucket_top(idx));
+        assert(idx == 0 || Histogram::bucket_top(idx - 1) < v);
+        assert(Histogram::bucket_top(idx) - v <= v / Histogram::SUB);
+    }
+    Histogram h;
+    for (uint64_t v = 1; v <= 1000; v += 1) h.record(v);
+    assert(h.count() == 1000 && h.max() == 1000 && h.mean() == 500);
+    assert(h.percentile(0.5) >= 500 && h.percentile(0.5) <= 500 + 500 / Histogram::SUB);
+    assert(h.percentile(1.0) == 1000);
+
+    auto* queues = new MessageQueueArray(2);
+    auto* a = new Distributable(0, new NetworkPseudo(queues));
+    auto* b = new Distributable(1, new NetworkPseudo(queues));
+    for (size_t i = 0; i < 10; i += 1) {
+        auto* arr = new FixedIntArray(1);
+        arr->pushBack(i);
+        a->put(1, (new String("stats-"))->concat(i), arr);
+    }
+    for (size_t i = 0; i < 10; i += 1) {
+        assert(a->get_int_chunk(1, (new String("stats-"))->concat(i))->get(0) == (int) i);
+    }
+    NetCounters* sa = a->network->stats.snapshot();
+    NetCounters* sb = b->network->stats.snapshot();
+    assert(sa->kinds[(size_t) MsgKind::Send].sent == 10 && sa->kinds[(size_t) MsgKind::Get].sent == 10);
+    assert(sa->kinds[(size_t) MsgKind::Ack].received == 10 && sa->kinds[(size_t) MsgKind::Send].received == 10);
+    assert(sb->kinds[(size_t) MsgKind::Get].received == 10 && sb->peers[0].sent == 20);
+    assert(sa->rtt(MsgKind::Send)->count() == 10 && sa->rtt(MsgKind::Get)->count() == 10);
+    assert(sa->rtt((size_t) 1)->count() == 20 && sb->rtt((size_t) 0) == nullptr);
+    delete sa;
+    delete sb;
+    a->network->shutdown();
+    b->network->shutdown();
+    delete a;
+    delete b;
+    delete queues;
+}
+
+/**
+ * The vector kernels agree with the scalar ones on every tail length, and a
+ * column aggregate over a pseudo cluster matches the values it was built from.
+ */
+void testAggregate() {
+    int ints[1003];
+    float floats[1003];
+    for (size_t i = 0; i < 1003; i += 1) {
+        ints[i] = (int) (i * 2654435761u % 200001) - 100000;
+        floats[i] = ints[i] / 8.0f;
+    }
+    for (size_t n = 0; n < 40; n += 1) {
+        IntAgg expect, got;
+        Kernels::aggregate_scalar_(ints + 3, n, expect);
+        Kernels::aggregate(ints + 3, n, got);
+        assert(got.sum == expect.sum && got.min == expect.min && got.max == expect.max && got.count == n);
+        FloatAgg fexpect, fgot;
+        Kernels::aggregate_scalar_(floats + 3, n, fexpect);
+        Kernels::aggregate(floats + 3, n, fgot);
+        assert(fgot.sum == fexpect.sum && fgot.min == fexpect.min && fgot.max == fexpect.max);
+    }
+
+    Task task("aggregate-int", "col", 7);
+    task.sender_ = 1;
+    task.target_ = 2;
+    task.id_ = 3;
+    task.data = std::string("a\0b", 3);
+    size_t size = 0;
+    char* buf = Serializer::serialize(&task, size);
+    Task* back = dynamic_cast<Task*>(Serializer::deserializeMessage(buf));
+    assert(back->name->equals(task.name) && back->key->equals(task.key) && back->arg == 7 && back->id_ == 3);
+    assert(back->data == task.data);
+    delete back;
+    delete[] buf;
+
+    withCluster([&](KDStore** kds) {
+        Key intKey("agg-ints", 0);
+        Key floatKey("agg-floats", 0);
+        delete DistDataFrame::fromArray(&intKey, kds[0], 1003, ints);
+        delete DistDataFrame::fromArray(&floatKey, kds[0], 1003, floats);
+        IntAgg expect;
+        FloatAgg fexpect;
+        Kernels::aggregate_scalar_(ints, 1003, expect);
+        Kernels::aggregate_scalar_(floats, 1003, fexpect);
+        DistDataFrame* df = kds[2]->waitAndGet(intKey);
+        IntAgg got = df->aggregate_int(0);
+        assert(got.sum == expect.sum && got.min == expect.min && got.max == expect.max && got.count == 1003);
+        delete df;
+        df = kds[4]->waitAndGet(floatKey);
+        FloatAgg fgot = df->aggregate_float(0);
+        assert(fgot.sum == fexpect.sum && fgot.min == fexpect.min && fgot.max == fexpect.max && fgot.count == 1003);
+        delete df;
+    });
+}
+
+/** Sums an int column a row at a time, through Reader's default visit_batch. */
+class RowSum : public Reader {
+    public:
+        int64_t sum = 0;
+        size_t rows = 0;
+        size_t next = 0; // rows come in order
+
+        bool visit(Row& r) override {
+            sum += r.get_int(0);
+            assert(r.get_idx() >= next);
+            next = r.get_idx() + 1;
+            rows += 1;
+            return true;
+        }
+};
+
+class BatchSum : public Reader {
+    public:
+        int64_t sum = 0;
+        size_t rows = 0;
+        size_t joined = 0;
+
+        void visit_batch(Batch& b) override {
+            FixedIntArray* col = b.int_col(0);
+            for (size_t i = 0; i < b.rows; i += 1) sum += col->get(i);
+            rows += b.rows;
+        }
+
+        Rower* clone() override {
+            return new BatchSum();
+        }
+
+        void join(Rower* other) override {
+            auto* o = dynamic_cast<BatchSum*>(other);
+            sum += o->sum;
+            rows += o->rows;
+            joined += 1 + o->joined;
+        }
+};
+
+/** Row and batch readers see every row exactly once, the short last chunk
+ *  included, whether they read on one thread or several. */
+void testBatchReader() {
+    withCluster([&](KDStore** kds) {
+        int vals[1003];
+        int64_t expect = 0;
+        for (size_t i = 0; i < 1003; i += 1) {
+            vals[i] = (int) i * 7 - 300;
+            expect += vals[i];
+        }
+        Key key("batch", 0);
+        delete DistDataFrame::fromArray(&key, kds[0], 1003, vals);
+        DistDataFrame* df = kds[3]->waitAndGet(key);
+        RowSum rowSum;
+        BatchSum batchSum;
+        df->map(&rowSum);
+        df->map(&batchSum);
+        assert(rowSum.rows == 1003 && rowSum.sum == expect);
+        assert(batchSum.rows == 1003 && batchSum.sum == expect);
+        delete df;
+        BatchSum local;
+        BatchSum parallel;
+        RowSum single;
+        for (size_t i = 0; i < 5; i += 1) {
+            df = kds[i]->get(key);
+            df->local_map(&local, 1);
+            df->local_map(&parallel, 3);
+            df->local_map(&single, 3); // cannot be cloned, so reads on one thread
+            single.next = 0;
+            delete df;
+        }
+        assert(local.rows == 1003 && local.sum == expect && local.joined == 0);
+        assert(parallel.rows == 1003 && parallel.sum == expect && parallel.joined == 10);
+        assert(single.rows == 1003 && single.sum == expect);
+    });
+}
+
+/** Writes rows (i, "row", i / 2.0) for i below n. */
+class Rows3 : public Writer {
+    public:
+        size_t i = 0;
+        size_t n;
+
+        explicit Rows3(size_t n_var) { n = n_var; }
+
+        void visit(Row& r) override {
+            r.set(0, (int) i);
+            r.set(1, new String("row"));
+            r.set(2, (float) (i / 2.0));
+            i += 1;
+        }
+
+        bool done() override { return i == n; }
+};
+
+class FloatSum : public Reader {
+    public:
+        double sum = 0;
+
+        void visit_batch(Batch& b) override {
+            assert(b.cols[0] == nullptr && b.cols[1] == nullptr);
+            FixedFloatArray* col = b.float_col(2);
+            for (size_t i = 0; i < b.rows; i += 1) sum += col->get(i);
+        }
+};
+
+/** A projected map fetches the chunks of the columns it reads and no others. */
+void testProjection() {
+    withCluster([&](KDStore** kds) {
+        Key key("proj", 0);
+        Rows3 rows(500);
+        delete DistDataFrame::fromVisitor(&key, kds[0], "ISF", &rows);
+        DistDataFrame* df = kds[2]->waitAndGet(key);
+        NetCounters* before = kds[2]->kvStore->network->stats.snapshot();
+        FloatSum sum;
+        df->map_cols(&sum, {2});
+        NetCounters* after = kds[2]->kvStore->network->stats.snapshot();
+        assert(sum.sum == 499 * 500 / 4.0);
+        size_t gets = after->kinds[(size_t) MsgKind::Get].sent - before->kinds[(size_t) MsgKind::Get].sent;
+        assert(gets == 8); // 10 chunks of column 2, two of them on node 2
+        delete before;
+        delete after;
+        FloatSum local;
+        df->local_map_cols(&local, {2}, 2);
+        assert(local.sum > 0 && local.sum < sum.sum);
+        delete df;
+    });
+}
+
+/** Keeps the rows whose first column is a multiple of three. */
+class Thirds : public Rower {
+    public:
+        bool accept(Row& r) override {
+            return r.get_int(0) % 3 == 0;
+        }
+};
+
+/** Sums the first column and checks the rest of each row follows from it. */
+class RowsCheck : public Reader {
+    public:
+        int64_t sum = 0;
+        size_t rows = 0;
+
+        void visit_batch(Batch& b) override {
+            for (size_t i = 0; i < b.rows; i += 1) {
+                int v = b.int_col(0)->get(i);
+                assert(v % 3 == 0 && b.float_col(2)->get(i) == (float) (v / 2.0));
+                assert(strcmp(b.str_col(1)->get(i)->c_str(), "row") == 0);
+                sum += v;
+            }
+            rows += b.rows;
+        }
+};
+
+size_t sendsFrom(KDStore* kd) {
+    NetCounters* snap = kd->kvStore->network->stats.snapshot();
+    size_t sends = snap->kinds[(size_t) MsgKind::Send].sent;
+    delete snap;
+    return sends;
+}
+
+void filterOn(KDStore* kd, size_t* sent) {
+    Key in("to-filter", 0);
+    Key out("filtered", 0);
+    DistDataFrame* df = kd->waitAndGet(in);
+    Thirds thirds;
+    size_t before = sendsFrom(kd);
+    delete df->filter(&thirds, out);
+    *sent = sendsFrom(kd) - before;
+    delete df;
+}
+
+void checkFiltered(KDStore* kd) {
+    Key out("filtered", 0);
+    DistDataFrame* kept = kd->waitAndGet(out);
+    RowsCheck check;
+    kept->map(&check);
+    assert(check.rows == 335 && check.sum == 3 * (334 * 335 / 2));
+    assert(kept->get_int(0, 0) == 0 && kept->get_int(0, 334) % 3 == 0);
+    assert(kept->get_float(2, 50) == kept->get_int(0, 50) / 2.0f);
+    assert(kept->aggregate_int(0).sum == check.sum);
+    delete kept;
+}
+
+/** A filter keeps the rows the rower accepts where they are: the only
+ *  sends off a node that does not own the result carry its row count. */
+void testFilter() {
+    withCluster([&](KDStore** kds) {
+        Key key("to-filter", 0);
+        Rows3 rows(1003);
+        delete DistDataFrame::fromVisitor(&key, kds[0], "ISF", &rows);
+        size_t sent[5];
+        onEachNode([&](size_t i) {
+            filterOn(kds[i], &sent[i]);
+        });
+        for (size_t i = 1; i < 5; i += 1) {
+            assert(sent[i] == 1);
+        }
+        onEachNode([&](size_t i) {
+            checkFiltered(kds[i]);
+        });
+    });
+}
+
+/** Writes rows (i % 7, "g" + i % 3, i / 4.0, i) for i below n. */
+class Groups : public Writer {
+    public:
+        size_t i = 0;
+        size_t n;
+
+        explicit Groups(size_t n_var) { n = n_var; }
+
+        void visit(Row& r) override {
+            r.set(0, (int) (i % 7));
+            r.set(1, (new String("g"))->concat(i % 3));
+            r.set(2, (float) (i / 4.0));
+            r.set(3, (int) i);
+            i += 1;
+        }
+
+        bool done() override { return i == n; }
+};
+
+/** Checks every group against the rows that fall in it. */
+class GroupsCheck : public Reader {
+    public:
+        size_t n;
+        size_t groups = 0;
+
+        explicit GroupsCheck(size_t n_var) { n = n_var; }
+
+        void visit_batch(Batch& b) override {
+            for (size_t r = 0; r < b.rows; r += 1) {
+                int mod7 = b.int_col(0)->get(r);
+                int mod3 = b.str_col(1)->get(r)->c_str()[1] - '0';
+                int count = 0, sum = 0, min = -1, max = -1;
+                for (size_t i = 0; i < n; i += 1) {
+                    if ((int) (i % 7) != mod7 || (int) (i % 3) != mod3) continue;
+                    if (min < 0) min = i;
+                    max = i;
+                    count += 1;
+                    sum += i;
+                }
+                assert(b.int_col(2)->get(r) == count && b.int_col(3)->get(r) == sum);
+                assert(b.float_col(4)->get(r) == min / 4.0f && b.float_col(5)->get(r) == max / 4.0f);
+                assert(b.float_col(6)->get(r) == (float) ((double) sum / 4.0 / count));
+                groups += 1;
+            }
+        }
+};
+
+void groupOn(KDStore* kd) {
+    Key in("to-group", 0);
+    Key out("grouped", 1);
+    DistDataFrame* df = kd->waitAndGet(in);
+    DistDataFrame* grouped = df->group_by({0, 1}, {Aggregate::count(), Aggregate::sum(3), Aggregate::min(2),
+                                                  Aggregate::max(2), Aggregate::mean(2)}, out);
+    GroupsCheck check(1003);
+    grouped->map(&check);
+    assert(check.groups == 21 && grouped->columns->get(0)->size() == 21);
+    delete grouped;
+    delete df;
+}
+
+/** A group-by on two key columns, run by every node of a pseudo cluster. */
+void testGroupBy() {
+    withCluster([&](KDStore** kds) {
+        Key key("to-group", 0);
+        Groups rows(1003);
+        delete DistDataFrame::fromVisitor(&key, kds[0], "ISFI", &rows);
+        onEachNode([&](size_t i) {
+            groupOn(kds[i]);
+        });
+    });
+}
+
+/** Writes rows (c % mod, "c" + c) for c below n. */
+class Customers : public Writer {
+    public:
+        size_t c = 0;
+        size_t n;
+        size_t mod;
+
+        Customers(size_t n_var, size_t mod_var) { n = n_var; mod = mod_var; }
+
+        void visit(Row& r) override {
+            r.set(0, (int) (c % mod));
+            r.set(1, (new String("c"))->concat(c));
+            c += 1;
+        }
+
+        bool done() override { return c == n; }
+};
+
+/** Writes rows (i, i % 57, i / 2.0) for i below n. */
+class Orders : public Writer {
+    public:
+        size_t i = 0;
+        size_t n;
+
+        explicit Orders(size_t n_var) { n = n_var; }
+
+        void visit(Row& r) override {
+            r.set(0, (int) i);
+            r.set(1, (int) (i % 57));
+            r.set(2, (float) (i / 2.0));
+            i += 1;
+        }
+
+        bool done() override { return i == n; }
+};
+
+/** Checks that every joined row pairs an order with a customer of the same id. */
+class JoinCheck : public Reader {
+    public:
+        size_t mod;
+        size_t rows = 0;
+
+        explicit JoinCheck(size_t mod_var) { mod = mod_var; }
+
+        void visit_batch(Batch& b) override {
+            for (size_t r = 0; r < b.rows; r += 1) {
+                int order = b.int_col(0)->get(r);
+                int customer = b.int_col(1)->get(r);
+                assert(customer == order % 57 && b.float_col(2)->get(r) == order / 2.0f);
+                assert(b.int_col(3)->get(r) == customer);
+                assert((size_t) atoi(b.str_col(4)->get(r)->c_str() + 1) % mod == (size_t) customer);
+                rows += 1;
+            }
+        }
+};
+
+void joinOn(KDStore* kd, const char* right, size_t mod, size_t expected) {
+    Key orders("orders", 0);
+    Key customers(right, 1);
+    Key out((std::string(right) + "-joined").c_str(), 2);
+    DistDataFrame* left = kd->waitAndGet(orders);
+    DistDataFrame* other = kd->waitAndGet(customers);
+    DistDataFrame* joined = left->join(other, {1}, {0}, out);
+    JoinCheck check(mod);
+    joined->map(&check);
+    assert(check.rows == expected && joined->columns->get(0)->size() == expected);
+    delete joined;
+    delete other;
+    delete left;
+}
+
+/**
+ * Joins 1003 orders with customers on a pseudo cluster, once against 50
+ * customers, which are copied to every node, and once against more than
+ * DistDataFrame::BROADCAST_ROWS, where both sides are shuffled and every
+ * id has two or three customers.
+ */
+void testJoin() {
+    withCluster([&](KDStore** kds) {
+        Key orders("orders", 0);
+        Key few("few", 1);
+        Key many("many", 1);
+        Orders rows(1003);
+        delete DistDataFrame::fromVisitor(&orders, kds[0], "IIF", &rows);
+        Customers small(50, 50);
+        delete DistDataFrame::fromVisitor(&few, kds[1], "IS", &small);
+        Customers big(DistDataFrame::BROADCAST_ROWS + 50, 5000);
+        delete DistDataFrame::fromVisitor(&many, kds[1], "IS", &big);
+        size_t smallMatches = 0;
+        size_t bigMatches = 0;
+        for (size_t i = 0; i < 1003; i += 1) {
+            size_t id = i % 57;
+            if (id < 50) smallMatches += 1;
+            bigMatches += id < 50 ? 3 : 2;
+        }
+        for (const char* right : {"few", "many"}) {
+            bool isSmall = strcmp(right, "few") == 0;
+            onEachNode([&](size_t i) {
+                joinOn(kds[i], right, isSmall ? 50 : 5000, isSmall ? smallMatches : bigMatches);
+            });
+        }
+    });
+}
+
+/** Writes rows (i, i * 7919 % 1009, "w" + i * 31 % 101) for i below n. */
+class Shuffled : public Writer {
+    public:
+        size_t i = 0;
+        size_t n;
+
+        explicit Shuffled(size_t n_var) { n = n_var; }
+
+        void visit(Row& r) override {
+            r.set(0, (int) i);
+            r.set(1, (int) (i * 7919 % 1009));
+            r.set(2, (new String("w"))->concat(i * 31 % 101));
+            i += 1;
+        }
+
+        bool done() override { return i == n; }
+};
+
+/** Checks that the rows come in order of column col and are all of the ids below n. */
+class SortedCheck : public Reader {
+    public:
+        size_t col;
+        bool descending;
+        size_t rows = 0;
+        size_t idSum = 0;
+        std::string lastWord;
+        int lastNum = 0;
+
+        SortedCheck(size_t col_var, bool descending_var) { col = col_var; descending = descending_var; }
+
+        void visit_batch(Batch& b) override {
+            assert(b.start == rows);
+            for (size_t r = 0; r < b.rows; r += 1) {
+                int id = b.int_col(0)->get(r);
+                assert(b.int_col(1)->get(r) == (int) (id * 7919 % 1009));
+                if (col == 1) {
+                    int num = b.int_col(1)->get(r);
+                    assert(rows == 0 || (descending ? num <= lastNum : num >= lastNum));
+                    lastNum = num;
+                } else {
+                    std::string word = b.str_col(2)->get(r)->c_str();
+                    assert(rows == 0 || (descending ? word <= lastWord : word >= lastWord));
+                    lastWord = word;
+                }
+                idSum += id;
+                rows += 1;
+            }
+        }
+};
+
+void sortOn(KDStore* kd) {
+    Key in("to-sort", 0);
+    Key byNum("sorted-num", 3);
+    Key byWord("sorted-word", 4);
+    DistDataFrame* df = kd->waitAndGet(in);
+    DistDataFrame* nums = df->sort(1, false, byNum);
+    DistDataFrame* words = df->sort(2, true, byWord);
+    SortedCheck numCheck(1, false);
+    nums->map(&numCheck);
+    SortedCheck wordCheck(2, true);
+    words->map(&wordCheck);
+    assert(numCheck.rows == 1003 && numCheck.idSum == 1003 * 1002 / 2);
+    assert(wordCheck.rows == 1003 && wordCheck.idSum == 1003 * 1002 / 2);
+    delete words;
+    delete nums;
+    delete df;
+}
+
+/** Sorts a frame by an int column and, descending, by a string one on a pseudo cluster. */
+void testSort() {
+    withCluster([&](KDStore** kds) {
+        Key key("to-sort", 0);
+        Shuffled rows(1003);
+        delete DistDataFrame::fromVisitor(&key, kds[0], "IIS", &rows);
+        onEachNode([&](size_t i) {
+            sortOn(kds[i]);
+        });
+    });
+}
+
+/** Gathers the words of the rows a node holds, and their ids. */
+class WordsHeld : public Reader {
+    public:
+        std::set<std::string> words;
+        size_t rows = 0;
+        size_t idSum = 0;
+
+        void visit_batch(Batch& b) override {
+            for (size_t r = 0; r < b.rows; r += 1) {
+                words.insert(b.str_col(2)->get(r)->c_str());
+                idSum += b.int_col(0)->get(r);
+                rows += 1;
+            }
+        }
+};
+
+void repartitionOn(KDStore* kd, WordsHeld* held) {
+    Key in("to-move", 0);
+    Key out("moved", 2);
+    DistDataFrame* df = kd->waitAndGet(in);
+    DistDataFrame* moved = df->repartition({2}, out);
+    moved->local_map(held, 1);
+    delete moved;
+    delete df;
+}
+
+/**
+ * Moves 100000 rows so that every word is on one node. The rows are big
+ * enough to go in several batches per pair of nodes.
+ */
+void testRepartition() {
+    withCluster([&](KDStore** kds) {
+        Key key("to-move", 0);
+        Shuffled rows(100000);
+        delete DistDataFrame::fromVisitor(&key, kds[0], "IIS", &rows);
+        WordsHeld held[5];
+        onEachNode([&](size_t i) {
+            repartitionOn(kds[i], &held[i]);
+        });
+        size_t rowsHeld = 0;
+        size_t idSum = 0;
+        size_t words = 0;
+        std::set<std::string> all;
+        for (size_t i = 0; i < 5; i += 1) {
+            rowsHeld += held[i].rows;
+            idSum += held[i].idSum;
+            words += held[i].words.size();
+            all.insert(held[i].words.begin(), held[i].words.end());
+        }
+        assert(rowsHeld == 100000 && idSum == (size_t) 100000 * 99999 / 2);
+        assert(all.size() == 101 && words == 101);
+    });
+}
+
+/** Writes rows (i, "s" + i / 100) for i below n: both columns clustered. */
+class Clustered : public Writer {
+    public:
+        size_t i = 0;
+        size_t n;
+
+        explicit Clustered(size_t n_var) { n = n_var; }
+
+        void visit(Row& r) override {
+            r.set(0, (int) i);
+            r.set(1, (new String("s"))->concat(i / 100));
+            i += 1;
+        }
+
+        bool done() override { return i == n; }
+};
+
+/** Counts the chunks it is handed and the rows of them pred accepts. */
+class CountWhere : public Reader {
+    public:
+        Rower* pred;
+        size_t chunks = 0;
+        size_t rows = 0;
+
+        explicit CountWhere(Rower* pred_var) { pred = pred_var; }
+
+        void visit_batch(Batch& b) override {
+            chunks += 1;
+            for (size_t r = 0; r < b.rows; r += 1) {
+                if (pred->accept(b.row(r))) rows += 1;
+            }
+        }
+};
+
+void zoneFilterOn(KDStore* kd) {
+    Key in("clustered", 0);
+    Key out("in-range", 3);
+    DistDataFrame* df = kd->waitAndGet(in);
+    InRange range(0, 'I', 500, 560);
+    DistDataFrame* kept = df->filter(&range, out);
+    assert(kept->columns->get(0)->size() == 61);
+    CountWhere again(&range);
+    kept->map_where(&again, &range);
+    assert(again.chunks == 2 && again.rows == 61);
+    delete kept;
+    delete df;
+}
+
+/**
+ * Range and string predicates over clustered columns read only the chunks
+ * whose zones could match, from the frame as written and from a filtered one.
+ */
+void testZoneMaps() {
+    withCluster([&](KDStore** kds) {
+        Key key("clustered", 0);
+        Clustered rows(1003);
+        delete DistDataFrame::fromVisitor(&key, kds[0], "IS", &rows);
+        DistDataFrame* df = kds[2]->waitAndGet(key);
+        InRange range(0, 'I', 500, 560);
+        CountWhere inRange(&range);
+        df->map_where(&inRange, &range);
+        assert(inRange.chunks == 2 && inRange.rows == 61);
+        InRange none(0, 'I', 2000, 3000);
+        CountWhere outside(&none);
+        df->map_where(&outside, &none);
+        assert(outside.chunks == 0);
+        StringIs is(1, "s3");
+        CountWhere matching(&is);
+        df->map_where(&matching, &is);
+        assert(matching.rows == 100 && matching.chunks == 2);
+        delete df;
+        onEachNode([&](size_t i) {
+            zoneFilterOn(kds[i]);
+        });
+    });
+}
+
+/**
+ * Lookups of a string read only the chunks whose Bloom filter lets it
+ * through: with 50 words a chunk, none for words the frame lacks.
+ */
+void testBloomFilters() {
+    withCluster([&](KDStore** kds) {
+        Key key("words", 0);
+        Shuffled rows(1003);
+        delete DistDataFrame::fromVisitor(&key, kds[0], "IIS", &rows);
+        DistDataFrame* df = kds[3]->waitAndGet(key);
+        DistStringColumn* words = df->columns->get(2)->as_string();
+        assert(df->contains(2, "w0") && df->contains(2, "w100") && !df->contains(2, "w101"));
+        size_t maybe = 0;
+        for (size_t chunkIdx = 0; chunkIdx < words->num_chunks(); chunkIdx += 1) {
+            for (const char* word : {"w101", "nope", "w", "w1000"}) {
+                if (words->may_hold(chunkIdx, word, strlen(word))) maybe += 1;
+            }
+        }
+        assert(maybe == 0);
+        StringIs is(2, "w7");
+        CountWhere matching(&is);
+        df->map_where(&matching, &is);
+        assert(matching.rows == 10 && matching.chunks == 10);
+        delete df;
+        Key plainKey("plain", 0);
+        Schema schema("IIS");
+        DistDataFrame* plain = new DistDataFrame(schema, &plainKey, kds[0]->kvStore);
+        plain->no_blooms();
+        Shuffled again(1003);
+        while (!again.done()) {
+            Row row(3);
+            again.visit(row);
+            plain->add_row(row);
+        }
+        plain->lock();
+        kds[0]->kvStore->send_finished_update(plainKey.key->c_str());
+        delete plain;
+        df = kds[3]->waitAndGet(plainKey);
+        assert(df->contains(2, "w0") && df->contains(2, "w100") && !df->contains(2, "w101"));
+        assert(df->columns->get(2)->as_string()->array->blooms.empty());
+        delete df;
+    });
+}
+
+size_t tasksFrom(KDStore* kd) {
+    NetCounters* snap = kd->kvStore->network->stats.snapshot();
+    size_t tasks = snap->kinds[(size_t) MsgKind::Task].sent;
+    delete snap;
+    return tasks;
+}
+
+void indexOn(KDStore* kd, size_t col, const char* name) {
+    Key in("words", 0);
+    Key out(name, 0);
+    DistDataFrame* df = kd->waitAndGet(in);
+    delete df->index(col, out);
+    delete df;
+}
+
+/** A point lookup in a hash index asks only the node that owns the value;
+ *  a batch of lookups asks each node at most once. */
+void testIndex() {
+    withCluster([&](KDStore** kds) {
+        Key key("words", 0);
+        Shuffled rows(1003);
+        delete DistDataFrame::fromVisitor(&key, kds[0], "IIS", &rows);
+        std::thread pids[5];
+        for (size_t i = 1; i < 5; i += 1) {
+            pids[i] = std::thread(indexOn, kds[i], 2, "words-by-word");
+        }
+        DistDataFrame* df = kds[0]->waitAndGet(key);
+        Key out("words-by-word", 0);
+        DistIndex* byWord = df->index(2, out);
+        for (size_t i = 1; i < 5; i += 1) {
+            pids[i].join();
+        }
+        size_t before = tasksFrom(kds[0]);
+        std::vector<RowRef> found = byWord->find("w7");
+        assert(tasksFrom(kds[0]) - before <= 1);
+        assert(found.size() == 10);
+        for (size_t i = 0; i < found.size(); i += 1) {
+            assert(strcmp(df->get_string(2, found[i].row)->c_str(), "w7") == 0);
+            assert(found[i].row == found[i].chunk * 50 + found[i].offset);
+            assert(i == 0 || found[i - 1].row < found[i].row);
+        }
+        assert(byWord->find("w101").empty() && byWord->find("").empty());
+        std::vector<const char*> words = {"w0", "nope", "w100", "w0"};
+        std::vector<std::vector<RowRef>> all = byWord->find_all(words);
+        assert(all[0].size() == 10 && all[1].empty() && all[2].size() == 10 && all[3].size() == 10);
+        delete byWord;
+
+        Key byNum("words-by-num", 0);
+        for (size_t i = 1; i < 5; i += 1) {
+            pids[i] = std::thread(indexOn, kds[i], 1, "words-by-num");
+        }
+        DistIndex* byValue = df->index(1, byNum);
+        for (size_t i = 1; i < 5; i += 1) {
+            pids[i].join();
+        }
+        std::vector<int> values;
+        for (int v = 0; v < 1009; v += 1) {
+            values.push_back(v);
+        }
+        before = tasksFrom(kds[0]);
+        std::vector<std::vector<RowRef>> hits = byValue->find_all(values);
+        assert(tasksFrom(kds[0]) - before <= 4);
+        size_t total = 0;
+        for (int v = 0; v < 1009; v += 1) {
+            for (RowRef& ref : hits[v]) {
+                assert(df->get_int(1, ref.row) == v);
+            }
+            total += hits[v].size();
+        }
+        assert(total == 1003);
+        delete byValue;
+        delete df;
+    });
+}
+
+void topOn(KDStore* kd, size_t* sent) {
+    Key in("words", 0);
+    Key best("words-top", 0);
+    Key bestPerWord("words-top-per-word", 0);
+    Key bestPerValue("words-top-per-value", 0);
+    DistDataFrame* df = kd->waitAndGet(in);
+    size_t before = sendsFrom(kd);
+    delete df->top_k(1, 5, best);
+    *sent = sendsFrom(kd) - before;
+    delete df->top_k(0, 3, {2}, bestPerWord);
+    delete df->top_k(0, 1, {1}, bestPerValue);
+    delete df;
+}
+
+/** Top-k moves at most k rows per group off each node: one message of
+ *  candidates and one with the count. Groups come in order of their keys'
+ *  values. */
+void testTopK() {
+    withCluster([&](KDStore** kds) {
+        Key key("words", 0);
+        Shuffled rows(1003);
+        delete DistDataFrame::fromVisitor(&key, kds[0], "IIS", &rows);
+        size_t sent[5];
+        onEachNode([&](size_t i) {
+            topOn(kds[i], &sent[i]);
+        });
+        for (size_t i = 1; i < 5; i += 1) {
+            assert(sent[i] == 2);
+        }
+        std::vector<int> values;
+        for (size_t i = 0; i < 1003; i += 1) {
+            values.push_back((int) (i * 7919 % 1009));
+        }
+        std::sort(values.rbegin(), values.rend());
+        Key best("words-top", 0);
+        DistDataFrame* top = kds[2]->waitAndGet(best);
+        assert(top->columns->get(0)->size() == 5);
+        for (size_t i = 0; i < 5; i += 1) {
+            assert(top->get_int(1, i) == values[i]);
+            assert(top->get_int(1, i) == top->get_int(0, i) * 7919 % 1009);
+        }
+        delete top;
+        Key bestPerWord("words-top-per-word", 0);
+        top = kds[4]->waitAndGet(bestPerWord);
+        assert(top->columns->get(0)->size() == 3 * 101);
+        for (size_t i = 0; i < 3 * 101; i += 1) {
+            int id = top->get_int(0, i);
+            String* word = top->get_string(2, i);
+            size_t r = id % 101;
+            int last = (int) (r + (1002 - r) / 101 * 101);
+            assert(strcmp(word->c_str(), (std::string("w") + std::to_string(id * 31 % 101)).c_str()) == 0);
+            if (i % 3 == 0) {
+                assert(id == last);
+                assert(i == 0 || strcmp(top->get_string(2, i - 3)->c_str(), word->c_str()) < 0);
+            } else {
+                assert(id == top->get_int(0, i - 1) - 101);
+                assert(strcmp(word->c_str(), top->get_string(2, i - 1)->c_str()) == 0);
+            }
+        }
+        delete top;
+        Key bestPerValue("words-top-per-value", 0);
+        top = kds[1]->waitAndGet(bestPerValue);
+        assert(top->columns->get(0)->size() == 1003);
+        for (size_t i = 1; i < 1003; i += 1) {
+            assert(top->get_int(1, i - 1) < top->get_int(1, i));
+        }
+        delete top;
+    });
+}
+
+/** Sketches from the nodes' chunks merge into the sketch of the whole
+ *  column, and estimate its distinct values and their counts; a node
+ *  reads the statistics analyze last kept, also after rows are added. */
+void testSketches() {
+    withCluster([&](KDStore** kds) {
+        Key key("words", 0);
+        Shuffled rows(1003);
+        delete DistDataFrame::fromVisitor(&key, kds[0], "IIS", &rows);
+        DistDataFrame* df = kds[1]->waitAndGet(key);
+        ColumnSketch ids = df->sketch(0);
+        ColumnSketch words = df->sketch(2);
+        ColumnSketch local;
+        for (size_t i = 0; i < 1003; i += 1) {
+            String word("w");
+            word.concat(i * 31 % 101);
+            local.add(ValueHash::of(&word));
+        }
+        assert(memcmp(&local, &words, sizeof(ColumnSketch)) == 0);
+        assert(ids.count == 1003 && words.count == 1003);
+        assert(std::fabs(ids.distinct_values() - 1003) < 1003 * 0.05);
+        assert(std::fabs(words.distinct_values() - 101) < 101 * 0.05);
+        assert(words.count_of("w7") >= 10 && words.count_of("w7") <= 12);
+        assert(words.count_of("nope") <= 2 && ids.count_of(5) == 1);
+        df->analyze();
+        delete df;
+        df = kds[3]->waitAndGet(key);
+        ColumnSketch kept = df->stats(2);
+        assert(memcmp(&kept, &words, sizeof(ColumnSketch)) == 0);
+        DistDataFrame* writer = kds[1]->waitAndGet(key);
+        writer->reopen();
+        Row row(3);
+        row.set(0, 1003);
+        row.set(1, 0);
+        row.set(2, new String("w-late"));
+        writer->add_row(row);
+        writer->commit();
+        writer->analyze();
+        kept = df->stats(2);
+        assert(kept.count == 1004 && kept.count_of("w-late") >= 1);
+        delete writer;
+        delete df;
+    });
+}
+
+/** Each word with a mark added, and twice the id. */
+class Marked : public Mapper {
+    public:
+        std::string types() override {
+            return "SI";
+        }
+
+        void map(Row& in, Row& out) override {
+            out.set(0, in.get_string(2)->clone()->concat("!"));
+            out.set(1, in.get_int(0) * 2);
+        }
+};
+
+/** Sums an int column, a chunk at a time. */
+class IntSum : public Reader {
+    public:
+        size_t col;
+        int64_t sum = 0;
+        size_t rows = 0;
+
+        explicit IntSum(size_t col_var) { col = col_var; }
+
+        void visit_batch(Batch& b) override {
+            for (size_t i = 0; i < b.rows; i += 1) {
+                sum += b.int_col(col)->get(i);
+            }
+            rows += b.rows;
+        }
+};
+
+void planOn(KDStore* kd) {
+    Key in("words", 0);
+    Key grouped("words-marked", 0);
+    Key collected("words-w7", 0);
+    DistDataFrame* df = kd->waitAndGet(in);
+    InRange firstHalf(0, 'I', 0, 499);
+    Marked marked;
+    Plan plan = df->plan();
+    plan.filter(&firstHalf).map(&marked);
+    delete plan.group_by({0}, {Aggregate::count(), Aggregate::sum(1)}, grouped);
+    StringIs w7(2, "w7");
+    Plan only = df->plan();
+    only.filter(&w7).project({2, 0});
+    delete only.collect(collected);
+    delete df;
+}
+
+/** A plan's steps run fused over each chunk, with no frame between them. */
+void testPlan() {
+    withCluster([&](KDStore** kds) {
+        Key key("words", 0);
+        Shuffled rows(1003);
+        delete DistDataFrame::fromVisitor(&key, kds[0], "IIS", &rows);
+        onEachNode([&](size_t i) {
+            planOn(kds[i]);
+        });
+        Key grouped("words-marked", 0);
+        DistDataFrame* counts = kds[2]->waitAndGet(grouped);
+        assert(counts->columns->get(0)->size() == 101);
+        IntSum rowCount(1);
+        IntSum idSum(2);
+        counts->map(&rowCount);
+        counts->map(&idSum);
+        assert(rowCount.sum == 500 && idSum.sum == 2 * (499 * 500 / 2));
+        for (size_t i = 0; i < 101; i += 1) {
+            String* word = counts->get_string(0, i);
+            assert(word->c_str()[0] == 'w' && word->c_str()[word->size() - 1] == '!');
+        }
+        delete counts;
+        Key collected("words-w7", 0);
+        DistDataFrame* w7 = kds[4]->waitAndGet(collected);
+        assert(w7->columns->size() == 2 && w7->columns->get(0)->size() == 10);
+        for (size_t i = 0; i < 10; i += 1) {
+            assert(strcmp(w7->get_string(0, i)->c_str(), "w7") == 0 && w7->get_int(1, i) * 31 % 101 == 7);
+        }
+        delete w7;
+        DistDataFrame* df = kds[1]->waitAndGet(key);
+        Plan ids = df->plan();
+        ids.project({1});
+        IntSum sum(0);
+        ids.run(&sum);
+        IntSum direct(1);
+        df->map(&direct);
+        assert(sum.rows == 1003 && sum.sum == direct.sum);
+        InRange low(0, 'I', 0, 99);
+        Rower any;
+        Plan early = df->plan();
+        early.filter(&low);
+        CountWhere pruned(&any);
+        early.run(&pruned);
+        assert(pruned.chunks == 2 && pruned.rows == 100);
+        CountWhere every(&any);
+        Pipeline whole(&early, &every);
+        df->map(&whole);
+        assert(every.chunks == 21 && every.rows == 100);
+        delete df;
+    });
+}
+
+/** Rows appended to a locked frame become visible all at once on commit:
+ *  a handle from before keeps the rows it had, one from after sees every
+ *  row, with zones and aggregates that cover the new chunks. */
+void testAppend() {
+    withCluster([&](KDStore** kds) {
+        Key key("words", 0);
+        Shuffled rows(1100);
+        Schema schema("IIS");
+        DistDataFrame* writer = new DistDataFrame(schema, &key, kds[0]->kvStore);
+        while (rows.i < 1003) {
+            Row row(3);
+            rows.visit(row);
+            writer->add_row(row);
+        }
+        writer->lock();
+        kds[0]->kvStore->send_finished_update(key.key->c_str());
+        DistDataFrame* before = kds[2]->waitAndGet(key);
+        writer->reopen();
+        while (!rows.done()) {
+            Row row(3);
+            rows.visit(row);
+            writer->add_row(row);
+        }
+        DistDataFrame* during = kds[4]->waitAndGet(key);
+        assert(during->columns->get(0)->size() == 1003);
+        delete during;
+        writer->commit();
+        DistDataFrame* after = kds[3]->waitAndGet(key);
+        assert(before->columns->get(0)->size() == 1003 && after->columns->get(0)->size() == 1100);
+        assert(after->columns->get(2)->num_chunks() == 23 && after->columns->get(2)->chunk_rows(20) == 3);
+        for (size_t i = 1000; i < 1100; i += 1) {
+            assert(after->get_int(0, i) == (int) i);
+            assert(strcmp(after->get_string(2, i)->c_str(), (std::string("w") + std::to_string(i * 31 % 101)).c_str()) == 0);
+        }
+        IntAgg agg = after->aggregate_int(0);
+        assert(agg.count == 1100 && agg.sum == 1099 * 1100 / 2);
+        assert(before->aggregate_int(0).count == 1003);
+        InRange range(0, 'I', 1040, 1060);
+        CountWhere late(&range);
+        after->map_where(&late, &range);
+        assert(late.chunks == 2 && late.rows == 21);
+        CountWhere early(&range);
+        before->map_where(&early, &range);
+        assert(early.chunks == 0 && early.rows == 0);
+        after->reopen();
+        Row row(3);
+        row.set(0, 1100);
+        row.set(1, 0);
+        row.set(2, new String("w-last"));
+        after->add_row(row);
+        after->commit();
+        DistDataFrame* last = kds[1]->waitAndGet(key);
+        assert(last->columns->get(0)->size() == 1101 && last->get_int(0, 1100) == 1100);
+        assert(last->contains(2, "w-last") && !before->contains(2, "w-last"));
+        delete last;
+        delete after;
+        delete before;
+        delete writer;
+    });
+}
+
+/** Writes ids 0 to n - 1, holding back after row gate until readers have
+ *  seen every chunk stored before it. */
+class Gated : public Writer {
+    public:
+        size_t i = 0;
+        size_t n;
+        size_t gate;
+        std::atomic<size_t>* seen;
+
+        Gated(size_t n_var, size_t gate_var, std::atomic<size_t>* seen_var) {
+            n = n_var;
+            gate = gate_var;
+            seen = seen_var;
+        }
+
+        void visit(Row& r) override {
+            while (i == gate && *seen < gate / 50) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            r.set(0, (int) i);
+            i += 1;
+        }
+
+        bool done() override { return i == n; }
+};
+
+/** Sums the ids of the batches it sees, counting them in seen as well. */
+class Landed : public Reader {
+    public:
+        std::atomic<size_t>* seen;
+        size_t rows = 0;
+        size_t sum = 0;
+
+        explicit Landed(std::atomic<size_t>* seen_var) { seen = seen_var; }
+
+        void visit_batch(Batch& b) override {
+            for (size_t r = 0; r < b.rows; r += 1) {
+                assert((size_t) b.int_col(0)->get(r) == b.start + r);
+                sum += b.int_col(0)->get(r);
+            }
+            rows += b.rows;
+            *seen += 1;
+        }
+};
+
+void streamOn(KDStore* kd, Landed* landed) {
+    Key key("ids", 0);
+    DistDataFrame* df = kd->stream(key, "I");
+    df->local_map(landed);
+    assert(df->columns->get(0)->size() == 1003 && df->get_int(0, 1002) == 1002);
+    delete df;
+}
+
+/** Readers of a frame being written take its chunks as they are stored:
+ *  the writer goes on only once they have read all it stored so far. */
+void testStream() {
+    withCluster([&](KDStore** kds) {
+        std::atomic<size_t> seen(0);
+        std::vector<Landed> landed(5, Landed(&seen));
+        std::thread pids[5];
+        for (size_t i = 0; i < 5; i += 1) {
+            pids[i] = std::thread(streamOn, kds[i], &landed[i]);
+        }
+        Key key("ids", 0);
+        Gated ids(1003, 500, &seen);
+        delete DistDataFrame::fromVisitor(&key, kds[0], "I", &ids);
+        size_t rows = 0;
+        size_t sum = 0;
+        for (size_t i = 0; i < 5; i += 1) {
+            pids[i].join();
+            assert(landed[i].rows == (i == 0 ? 203 : 200));
+            rows += landed[i].rows;
+            sum += landed[i].sum;
+        }
+        assert(rows == 1003 && sum == 1002 * 1003 / 2 && seen == 21);
+    });
 }
 
 int main(int argc, char** argv) {
     testMessageDirectory();
     testMessageGet();
     testMessageSend();
+    testMessageSendTyped();
+    testMessageSendCompressed();
     testMessageRegister();
     testTrivial();
     testWordCount();
+    testTrivialPseudo();
+    testWordCountPseudo();
+    testConcurrentRequests();
+    testMeshStartup();
+    testBroadcast();
+    testPool();
+    testStats();
+    testAggregate();
+    testBatchReader();
+    testProjection();
+    testFilter();
+    testGroupBy();
+    testJoin();
+    testSort();
+    testRepartition();
+    testZoneMaps();
+    testBloomFilters();
+    testIndex();
+    testTopK();
+    testSketches();
+    testPlan();
+    testAppend();
+    testStream();
     std::cout<<"Tests passed\n";
     return 0;
 }
@@ -1,13 +1,29 @@
 #include "application.h"
 
+/**
+ * Usage: wc -f <file> [-net ip|pseudo] [-stats]
+ * With "-net pseudo" the five nodes exchange messages through in-process
+ * queues instead of TCP sockets. "-stats" prints every node's message counts
+ * and round trip times to stderr at the end.
+ */
 int main(int argc, char** argv) {
-    assert(argc == 3);
+    assert(argc >= 3 && strcmp(argv[1], "-f") == 0);
     char* file_name = argv[2];
+    bool pseudo = false;
+    bool stats = false;
+    for (int i = 3; i < argc; i += 1) {
+        if (strcmp(argv[i], "-net") == 0 && i + 1 < argc) {
+            pseudo = strcmp(argv[++i], "pseudo") == 0;
+        } else if (strcmp(argv[i], "-stats") == 0) {
+            stats = true;
+        }
+    }
+    MessageQueueArray* queues = pseudo ? new MessageQueueArray(5) : nullptr;
     auto** kds = new KDStore*[5];
     auto* pids = new std::thread[5];
     auto** wcs = new WordCount*[5];
     for (size_t i = 0; i < 5; i += 1) {
-        kds[i] = new KDStore(i);
+        kds[i] = pseudo ? new KDStore(i, new NetworkPseudo(queues)) : new KDStore(i);
         wcs[i] = new WordCount(i, kds[i], file_name, true);
     }
     for (size_t i = 0; i < 5; i += 1) {
@@ -16,6 +32,9 @@ int main(int argc, char** argv) {
     for (size_t i = 0; i < 5; i += 1) {
         pids[i].join();
     }
+    for (size_t i = 0; stats && i < 5; i += 1) {
+        kds[i]->kvStore->network->stats.dump(stderr);
+    }
     for (size_t i = 0; i < 5; i += 1) {
         kds[i]->kvStore->network->shutdown();
         kds[i]->kvStore->network->shutdown_open_conns();
@@ -27,5 +46,6 @@ int main(int argc, char** argv) {
     delete[] wcs;
     delete[] kds;
     delete[] pids;
+    delete queues;
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstring>
+#include <stdint.h>
+#include "object.h"
+
+/**
+ * A small LZ77 block codec in the style of LZ4. A block is a run of
+ * sequences, each a token byte (literal count in the high nibble, match
+ * length - MIN_MATCH in the low nibble, 15 meaning "more bytes follow"),
+ * the literals, and a two byte little endian offset back into the output.
+ * The last sequence carries literals only. Matches are found greedily
+ * through a hash of the next four bytes; there is no entropy coding, so
+ * both directions stay cheap next to a network round trip.
+ */
+class LZ : public Object {
+    public:
+        static const size_t MIN_MATCH = 4;
+        static const size_t HASH_BITS = 12;
+        static const size_t MAX_OFFSET = 65535;
+        static const size_t LAST_LITERALS = 5; // a block always ends with this many literals
+
+        /** The most a block of size bytes can grow by compressing it. */
+        static size_t bound(size_t size) {
+            return size + size / 255 + 16;
+        }
+
+        /** Compresses src into dst, which must hold bound(size) bytes. Returns the
+         *  compressed size. */
+        static size_t compress(const char* src, size_t size, char* dst) {
+            const unsigned char* in = reinterpret_cast<const unsigned char*>(src);
+            unsigned char* out = reinterpret_cast<unsigned char*>(dst);
+            uint32_t table[1 << HASH_BITS];
+            size_t bits = 8; // small blocks don't pay for clearing a large table
+            while (bits < HASH_BITS && ((size_t) 1 << bits) < size) bits += 1;
+            memset(table, 0, sizeof(uint32_t) << bits);
+            size_t anchor = 0;
+            size_t pos = 0;
+            size_t op = 0;
+            size_t limit = size > LAST_LITERALS + MIN_MATCH ? size - LAST_LITERALS - MIN_MATCH : 0;
+            while (pos < limit) {
+                uint32_t h = hash_(in + pos, bits);
+                size_t cand = table[h];
+                table[h] = (uint32_t) pos;
+                if (cand >= pos || pos - cand > MAX_OFFSET || memcmp(in + cand, in + pos, MIN_MATCH) != 0) {
+                    pos += 1;
+                    continue;
+                }
+                size_t len = MIN_MATCH;
+                while (pos + len < size - LAST_LITERALS && in[cand + len] == in[pos + len]) len += 1;
+                op = sequence_(out, op, in + anchor, pos - anchor, len, pos - cand);
+                pos += len;
+                anchor = pos;
+            }
+            return sequence_(out, op, in + anchor, size - anchor, 0, 0);
+        }
+
+        /** Decompresses a block of size bytes into dst, which must hold exactly
+         *  raw bytes. Returns false if the block is malformed. */
+        static bool decompress(const char* src, size_t size, char* dst, size_t raw) {
+            const unsigned char* in = reinterpret_cast<const unsigned char*>(src);
+            unsigned char* out = reinterpret_cast<unsigned char*>(dst);
+            size_t ip = 0;
+            size_t op = 0;
+            while (ip < size) {
+                unsigned char token = in[ip++];
+                size_t literals = token >> 4;
+                if (literals == 15 && !length_(in, size, ip, literals)) return false;
+                if (ip + literals > size || op + literals > raw) return false;
+                memcpy(out + op, in + ip, literals);
+                ip += literals;
+                op += literals;
+                if (ip == size) break; // the last sequence has no match
+                if (ip + 2 > size) return false;
+                size_t offset = in[ip] | (in[ip + 1] << 8);
+                ip += 2;
+                size_t len = token & 15;
+                if (len == 15 && !length_(in, size, ip, len)) return false;
+                len += MIN_MATCH;
+                if (offset == 0 || offset > op || op + len > raw) return false;
+                if (offset >= len) {
+                    memcpy(out + op, out + op - offset, len);
+                    op += len;
+                } else {
+                    for (size_t i = 0; i < len; i += 1, op += 1) {
+                        out[op] = out[op - offset]; // overlapping match: byte by byte
+                    }
+                }
+            }
+            return op == raw;
+        }
+
+        static uint32_t hash_(const unsigned char* p, size_t bits) {
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            return (v * 2654435761u) >> (32 - bits);
+        }
+
+        /** Writes one sequence; a zero len writes the trailing literals only. */
+        static size_t sequence_(unsigned char* out, size_t op, const unsigned char* lit, size_t literals,
+                                size_t len, size_t offset) {
+            size_t token = op++;
+            size_t match = len == 0 ? 0 : len - MIN_MATCH;
+            out[token] = (unsigned char) (((literals < 15 ? literals : 15) << 4) | (match < 15 ? match : 15));
+            if (literals >= 15) op = extend_(out, op, literals - 15);
+            memcpy(out + op, lit, literals);
+            op += literals;
+            if (len == 0) return op;
+            out[op++] = (unsigned char) (offset & 255);
+            out[op++] = (unsigned char) (offset >> 8);
+            if (match >= 15) op = extend_(out, op, match - 15);
+            return op;
+        }
+
+        static size_t extend_(unsigned char* out, size_t op, size_t rest) {
+            while (rest >= 255) {
+                out[op++] = 255;
+                rest -= 255;
+            }
+            out[op++] = (unsigned char) rest;
+            return op;
+        }
+
+        static bool length_(const unsigned char* in, size_t size, size_t& ip, size_t& len) {
+            unsigned char b;
+            do {
+                if (ip == size) return false;
+                b = in[ip++];
+                len += b;
+            } while (b == 255);
+            return true;
+        }
+};
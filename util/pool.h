@@ -0,0 +1,145 @@
+#pragma once
+
+#include <mutex>
+#include <new>
+#include <stddef.h>
+
+/**
+ * A small-block allocator for the objects the network layer creates and drops
+ * once per message: messages, their keys, the transfers and the chunks they
+ * carry. Blocks come in size classes of ALIGN bytes up to MAX_SIZE. A freed
+ * block goes on the freeing thread's own list, and lists move to and from a
+ * shared one BATCH blocks at a time, so a steady stream of messages neither
+ * takes the heap's locks nor, most of the time, the pool's. Memory is carved
+ * from the heap a slab at a time and never given back; anything larger than
+ * MAX_SIZE goes straight to the heap.
+ *
+ * A class opts in by mixing in Pooled; raw buffers call alloc and free
+ * directly and must hand back the size they asked for.
+ */
+class Pool {
+    public:
+        static const size_t ALIGN = 16;
+        static const size_t MAX_SIZE = 512;
+        static const size_t CLASSES = MAX_SIZE / ALIGN;
+        static const size_t BATCH = 32;
+        static const size_t SLAB = 64 * 1024;
+
+        struct Block {
+            Block* next;
+        };
+
+        struct Shared {
+            std::mutex lock;
+            Block* free[CLASSES] = {};
+        };
+
+        /** One thread's free lists; handed back to the shared ones when the thread exits. */
+        struct Cache {
+            Block* free[CLASSES] = {};
+            size_t count[CLASSES] = {};
+            bool dead = false;
+
+            ~Cache() {
+                for (size_t cls = 0; cls < CLASSES; cls += 1) {
+                    if (count[cls] > 0) spill_(*this, cls, count[cls]);
+                }
+                dead = true;
+            }
+        };
+
+        static void* alloc(size_t size) {
+            if (size > MAX_SIZE) return ::operator new(size);
+            size_t cls = class_(size);
+            Cache& cache = cache_();
+            if (cache.free[cls] == nullptr) refill_(cache, cls);
+            Block* block = cache.free[cls];
+            cache.free[cls] = block->next;
+            cache.count[cls] -= 1;
+            return block;
+        }
+
+        /** Returns a block from alloc; size must be the size it was allocated with. */
+        static void free(void* p, size_t size) {
+            if (p == nullptr) return;
+            if (size > MAX_SIZE) {
+                ::operator delete(p);
+                return;
+            }
+            size_t cls = class_(size);
+            Block* block = static_cast<Block*>(p);
+            Cache& cache = cache_();
+            if (cache.dead) { // freed during static destruction, after this thread's cache
+                std::lock_guard<std::mutex> lck(shared_().lock);
+                block->next = shared_().free[cls];
+                shared_().free[cls] = block;
+                return;
+            }
+            block->next = cache.free[cls];
+            cache.free[cls] = block;
+            cache.count[cls] += 1;
+            if (cache.count[cls] >= 2 * BATCH) spill_(cache, cls, BATCH);
+        }
+
+        static size_t class_(size_t size) {
+            return size == 0 ? 0 : (size - 1) / ALIGN;
+        }
+
+        /** Never destroyed, so blocks can come back at any point of shutdown. */
+        static Shared& shared_() {
+            static Shared* shared = new Shared();
+            return *shared;
+        }
+
+        static Cache& cache_() {
+            static thread_local Cache cache;
+            return cache;
+        }
+
+        /** Takes up to BATCH blocks off the shared list, carving a new slab if it is empty. */
+        static void refill_(Cache& cache, size_t cls) {
+            Shared& shared = shared_();
+            std::lock_guard<std::mutex> lck(shared.lock);
+            if (shared.free[cls] == nullptr) {
+                size_t blockSize = (cls + 1) * ALIGN;
+                char* slab = static_cast<char*>(::operator new(SLAB));
+                for (size_t off = 0; off + blockSize <= SLAB; off += blockSize) {
+                    Block* block = reinterpret_cast<Block*>(slab + off);
+                    block->next = shared.free[cls];
+                    shared.free[cls] = block;
+                }
+            }
+            for (size_t i = 0; i < BATCH && shared.free[cls] != nullptr; i += 1) {
+                Block* block = shared.free[cls];
+                shared.free[cls] = block->next;
+                block->next = cache.free[cls];
+                cache.free[cls] = block;
+                cache.count[cls] += 1;
+            }
+        }
+
+        /** Moves the first n blocks of the thread's list to the shared one. */
+        static void spill_(Cache& cache, size_t cls, size_t n) {
+            Block* first = cache.free[cls];
+            Block* last = first;
+            for (size_t i = 1; i < n; i += 1) last = last->next;
+            cache.free[cls] = last->next;
+            cache.count[cls] -= n;
+            Shared& shared = shared_();
+            std::lock_guard<std::mutex> lck(shared.lock);
+            last->next = shared.free[cls];
+            shared.free[cls] = first;
+        }
+};
+
+/** Routes a class's allocations through the Pool; mix in next to Object. */
+class Pooled {
+    public:
+        static void* operator new(size_t size) {
+            return Pool::alloc(size);
+        }
+
+        static void operator delete(void* p, size_t size) {
+            Pool::free(p, size);
+        }
+};
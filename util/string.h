@@ -4,47 +4,40 @@
 #include <string>
 #include <cassert>
 #include "object.h"
+#include "pool.h"
 
 /** An immutable string class that wraps a character array.
  * The character array is zero terminated. The size() of the
- * String does count the terminator character. Most operations
- * work by copy, but there are exceptions (this is mostly to support
- * large strings and avoid them being copied).
+ * String does count the terminator character. Every operation
+ * works by copy; the characters live in storage from the Pool, so a
+ * String never takes over, or hands out, a buffer of its own.
  *  author: vitekj@me.com */
-class String : public Object {
+class String : public Object, public Pooled {
     public:
         size_t size_; // number of characters excluding terminate (\0)
-        char *cstr_;  // owned; char array
+        char *cstr_;  // owned; char array of size_ + 1 from the Pool
 
         /** Build a string from a string constant */
         String(char const *cstr, size_t len) {
             size_ = len;
-            cstr_ = new char[size_ + 1];
-            memcpy(cstr_, cstr, size_ + 1);
+            cstr_ = static_cast<char*>(Pool::alloc(size_ + 1));
+            memcpy(cstr_, cstr, size_);
             cstr_[size_] = 0; // terminate
         }
 
-        /** Builds a string from a char*, steal must be true, we do not copy!
-         *  cstr must be allocated for len+1 and must be zero terminated. */
-        String(bool steal, char *cstr, size_t len) {
-            assert(steal && cstr[len] == 0);
-            size_ = len;
-            cstr_ = cstr;
-        }
-
         String(char const *cstr) : String(cstr, strlen(cstr)) {}
 
         /** Build a string from another String */
         String(String &from) :
                 Object(from) {
             size_ = from.size_;
-            cstr_ = new char[size_ + 1]; // ensure that we copy the terminator
+            cstr_ = static_cast<char*>(Pool::alloc(size_ + 1)); // ensure that we copy the terminator
             memcpy(cstr_, from.cstr_, size_);
             cstr_[size_] = '\0';
         }
 
         /** Delete the string */
-        ~String() { delete[] cstr_; }
+        ~String() { Pool::free(cstr_, size_ + 1); }
 
         /** Return the number characters in the string (does not count the terminator) */
         size_t size() { return size_; }
@@ -70,13 +63,6 @@ class String : public Object {
         /** Deep copy of this string */
         String *clone() { return new String(*this); }
 
-        /** This consumes cstr_, the String must be deleted nextSizeT */
-        char *steal() {
-            char *res = cstr_;
-            cstr_ = nullptr;
-            return res;
-        }
-
         /** Compute a hash for this string. */
         size_t hash_me() {
             size_t hash = 0;
@@ -87,23 +73,21 @@ class String : public Object {
 
         /** Concat char* to this string. */
         String* concat(const char* csr) {
-            size_t newSize = size_ + strlen(csr) + 1;
-            char* newCstr = new char[newSize];
-            strcpy(newCstr, cstr_);
-            strcat(newCstr, csr);
-            size_ = newSize - 1;
-            newCstr[size_] = '\0';
-            delete[] cstr_;
+            size_t len = strlen(csr);
+            char* newCstr = static_cast<char*>(Pool::alloc(size_ + len + 1));
+            memcpy(newCstr, cstr_, size_);
+            memcpy(newCstr + size_, csr, len + 1);
+            Pool::free(cstr_, size_ + 1);
+            size_ += len;
             cstr_ = newCstr;
             return this;
         }
 
         /** Concat the string value of num to this string. */
         String* concat(size_t num) {
-            char* buf = new char[length(num) + 1];
-            sprintf(buf, "%zu", num);
+            char buf[24];
+            snprintf(buf, sizeof(buf), "%zu", num);
             concat(buf);
-            delete[] buf;
             return this;
         }
 };